@@ -2,11 +2,33 @@
 #include <sstream>
 #include <stdexcept>
 #include <memory>
+#include <algorithm>
+#include <chrono>
 
 #include "alsa.h"
 
 namespace ockl {
 
+namespace {
+
+::snd_pcm_format_t
+alsaFormat(SampleFormat format)
+{
+	switch (format) {
+	case SampleFormat::S16:
+		return SND_PCM_FORMAT_S16_LE;
+	case SampleFormat::S24:
+		return SND_PCM_FORMAT_S24_3LE;
+	case SampleFormat::S32:
+		return SND_PCM_FORMAT_S32_LE;
+	case SampleFormat::Float:
+		return SND_PCM_FORMAT_FLOAT_LE;
+	}
+	return SND_PCM_FORMAT_UNKNOWN;
+}
+
+} // namespace
+
 #define THROW_SND_ERROR(_msg, _errorcode)	\
 	std::ostringstream _oss;				\
 	_oss << _msg << ": ";					\
@@ -17,13 +39,33 @@ Alsa::
 Alsa(const std::string& deviceName,
 		unsigned samplingRate,
 		unsigned periodSize,
-		Queue<SamplingType>& queue,
+		bool useMmap,
+		const std::vector<SampleFormat>& formats,
+		const ThreadSettings& threadSettings,
+		const std::vector<Queue<SamplingType>*>& queues,
 		const Logger& logger)
 : pcmHandle(nullptr),
   deviceName(deviceName),
   samplingRate(samplingRate),
   periodSize(periodSize),
-  queue(queue),
+  elementSize(queues.front()->getElementSize()),
+  useMmap(useMmap),
+  formats(formats),
+  format(SampleFormat::S16),
+  convert(nullptr),
+  frameSize(0),
+  queues(queues),
+  channels(queues.size()),
+  bufferSize(0),
+  pendingLostFrames(0),
+  xruns(0),
+  lostFrames(0),
+  maxRecoveryTime(0),
+  deferred(false),
+  wakeups(0),
+  totalWakeupLatency(0),
+  maxWakeupLatency(0),
+  threadSettings(threadSettings),
   logger(logger),
   thread(nullptr),
   doShutdown(false)
@@ -56,12 +98,6 @@ init()
 		throw std::runtime_error("alsa already initialized");
 	}
 
-	// This should have been solved a bit more elegantly, but there is a
-	// dependency between the type we are pushing into the queue and the
-	// sampling format of the alsa configuration.
-	static_assert(sizeof(SamplingType) == 2, "");
-	static_assert(samplingFormat == SND_PCM_FORMAT_S16_LE, "");
-
 	int result = ::snd_pcm_open(&pcmHandle, deviceName.c_str(),
 			SND_PCM_STREAM_CAPTURE, 0);
 	if (result < 0) {
@@ -96,16 +132,13 @@ initParams()
 	}
 
 	result = ::snd_pcm_hw_params_set_access(pcmHandle, hwParams,
-			SND_PCM_ACCESS_RW_INTERLEAVED);
+			useMmap ? SND_PCM_ACCESS_MMAP_INTERLEAVED
+					: SND_PCM_ACCESS_RW_INTERLEAVED);
 	if (result < 0) {
 		THROW_SND_ERROR("failed to set access type", result);
 	}
 
-	result = ::snd_pcm_hw_params_set_format(pcmHandle, hwParams,
-			samplingFormat);
-	if (result < 0) {
-		THROW_SND_ERROR("failed to set sample format", result);
-	}
+	initFormat(hwParams);
 
 	unsigned int actualSamplingRate = samplingRate;
 	result = ::snd_pcm_hw_params_set_rate_near(pcmHandle, hwParams,
@@ -120,8 +153,7 @@ initParams()
 		throw std::runtime_error(oss.str());
 	}
 
-	// no stereo, only mono
-	result = ::snd_pcm_hw_params_set_channels(pcmHandle, hwParams, 1);
+	result = ::snd_pcm_hw_params_set_channels(pcmHandle, hwParams, channels);
 	if (result < 0) {
 		THROW_SND_ERROR("failed to set number of channels", result);
 	}
@@ -133,14 +165,11 @@ initParams()
 		THROW_SND_ERROR("failed to set period size", result);
 	}
 	if (actualPeriodSize != periodSize) {
-		// The soundcard not supporting this specific period size (probably
-		// because some hw buffer is not large enough or whatever) should not
-		// cause such drastic failure. Instead we should have some kind of
-		// buffering here in this class.
-		std::ostringstream oss;
-		oss << "period size rejected by alsa driver: set to "
-			<< actualPeriodSize << " (requested " << periodSize << ")";
-		throw std::runtime_error(oss.str());
+		// No problem, the queue elements are filled from as many periods
+		// as needed.
+		LOGGER_INFO("alsa driver chose a period size of " << actualPeriodSize
+				<< " (requested " << periodSize << ")");
+		periodSize = actualPeriodSize;
 	}
 
 	result = ::snd_pcm_hw_params(pcmHandle, hwParams);
@@ -150,6 +179,11 @@ initParams()
 
 	printInfo(hwParams);
 
+	result = ::snd_pcm_hw_params_get_buffer_size(hwParams, &bufferSize);
+	if (result < 0) {
+		THROW_SND_ERROR("failed to get buffer size", result);
+	}
+
 	::snd_pcm_sw_params_t* swParams;
 	result = ::snd_pcm_sw_params_malloc(&swParams);
 	if (result < 0) {
@@ -170,12 +204,53 @@ initParams()
     	THROW_SND_ERROR("failed to set available min", result);
     }
 
+	// Timestamps of the hardware pointer updates, against which the wakeup
+	// latency of the capture thread is measured.
+	if (::snd_pcm_sw_params_set_tstamp_mode(pcmHandle, swParams,
+			SND_PCM_TSTAMP_ENABLE) < 0
+			|| ::snd_pcm_sw_params_set_tstamp_type(pcmHandle, swParams,
+					SND_PCM_TSTAMP_TYPE_MONOTONIC) < 0) {
+		LOGGER_INFO("device has no monotonic timestamps, wakeup latency "
+				"not measured");
+	}
+
     result = ::snd_pcm_sw_params(pcmHandle, swParams);
     if (result < 0) {
     	THROW_SND_ERROR("failed to set sw_params_t", result);
     }
 }
 
+/**
+ * Sets the first of the formats the device supports and picks the
+ * converter for it.
+ */
+void
+Alsa::
+initFormat(::snd_pcm_hw_params_t* params)
+{
+	for (SampleFormat candidate : formats) {
+		if (::snd_pcm_hw_params_test_format(pcmHandle, params,
+				alsaFormat(candidate)) < 0) {
+			LOGGER_DEBUG("sample format " << sampleFormatName(candidate)
+					<< " not supported by the device");
+			continue;
+		}
+
+		int result = ::snd_pcm_hw_params_set_format(pcmHandle, params,
+				alsaFormat(candidate));
+		if (result < 0) {
+			THROW_SND_ERROR("failed to set sample format", result);
+		}
+		format = candidate;
+		convert = sampleConverter(format);
+		frameSize = sampleSize(format) * channels;
+		LOGGER_INFO("sample format: " << sampleFormatName(format));
+		return;
+	}
+	throw std::runtime_error("none of the sample formats is supported by "
+			"the device");
+}
+
 void
 Alsa::
 printInfo(::snd_pcm_hw_params_t* params)
@@ -248,6 +323,8 @@ start()
 
 	thread = new std::thread(&Alsa::threadFunction, this);
 	pthread_setname_np(thread->native_handle(), "alsa");
+	configureThread(*thread, threadSettings);
+	LOGGER_INFO("alsa thread: " << describe(threadSettings));
 }
 
 void
@@ -277,62 +354,386 @@ threadFunction()
 		return;
 	}
 
+	// the current elements, null while there are none
+	std::vector<SamplingType*> buffers(channels, nullptr);
+	// frames already in buffers
+	::snd_pcm_uframes_t fill = 0;
+	if (!useMmap) {
+		interleaved.resize(periodSize * frameSize);
+	}
+
 	while (!doShutdown) {
 		result = ::snd_pcm_wait(pcmHandle, Timeout.count());
 		if (result == 0) {
 			continue; // timeout
-		} else if (result < 0) {
+		}
+
+		if (result < 0 && !isXrun(result)) {
 			std::ostringstream oss;
 			oss << "error while waiting for data: " << ::snd_strerror(result);
 			LOGGER_ERROR(oss.str());
 			break;
 		}
 
-		snd_pcm_sframes_t numberFrames = ::snd_pcm_avail_update(pcmHandle);
-		if (numberFrames == 0) {
-			std::ostringstream oss;
-			oss << "device not ready?";
-			LOGGER_ERROR(oss.str());
-			break;
-		} else if (numberFrames == -EPIPE) {
-			LOGGER_ERROR("overrun occured - frames have been lost");
-			// this path has never been tested - do we need to call
-			// snd_pcm_prepare again?
-			continue;
-		} else if (numberFrames < 0) {
-			std::ostringstream oss;
-			oss << "error while asking for available frames: " << ::snd_strerror(numberFrames);
-			LOGGER_ERROR(oss.str());
+		if (result > 0) {
+			if (!deferred) {
+				measureWakeup();
+			}
+			deferred = false;
+			snd_pcm_sframes_t numberFrames = ::snd_pcm_avail_update(pcmHandle);
+			if (numberFrames == 0) {
+				std::ostringstream oss;
+				oss << "device not ready?";
+				LOGGER_ERROR(oss.str());
+				break;
+			} else if (numberFrames < 0 && !isXrun(numberFrames)) {
+				std::ostringstream oss;
+				oss << "error while asking for available frames: " << ::snd_strerror(numberFrames);
+				LOGGER_ERROR(oss.str());
+				break;
+			}
+
+			result = numberFrames < 0 ? numberFrames
+					: capture(numberFrames, buffers, fill);
+		}
+
+		// An overrun can be reported by any of the calls above.
+		if (isXrun(result)) {
+			if (!recover(result, fill)) {
+				break;
+			}
+		} else if (result < 0) {
 			break;
-		} else if ((snd_pcm_uframes_t)numberFrames < periodSize) {
-			continue;
 		}
+	}
 
-		SamplingType* buffer = queue.allocate();
-		if (buffer == nullptr) {
-			continue;
+	unallocate(buffers);
+
+	result = ::snd_pcm_drop(pcmHandle);
+	if (result < 0) {
+		std::ostringstream oss;
+		oss << "failed to drop device: " << ::snd_strerror(result);
+		LOGGER_ERROR(oss.str());
+	}
+
+	LOGGER_INFO("alsa thread exiting");
+}
+
+/**
+ * Moves the available frames into the queue elements, at most up to the
+ * end of the current elements. `fill` is the number of frames already in
+ * the current elements, which are pushed once full. Frames lost in an
+ * overrun are recorded in the first element filled afterwards.
+ *
+ * \return  0 or a negative error code
+ */
+int
+Alsa::
+capture(::snd_pcm_uframes_t available, std::vector<SamplingType*>& buffers,
+		::snd_pcm_uframes_t& fill)
+{
+	while (available > 0) {
+		if (fill == 0) {
+			// after an overrun the elements are still there, to be refilled
+			if (!allocate(buffers)) {
+				deferred = true;
+				return 0; // leave the frames in the driver for now
+			}
+			// the oldest available frame was captured `available` frames ago
+			auto age = std::chrono::microseconds(
+					(uint64_t) available * 1000000 / samplingRate);
+			auto captureTime = std::chrono::system_clock::now() - age;
+			captureStart = std::chrono::steady_clock::now() - age;
+			for (unsigned channel = 0; channel < channels; channel++) {
+				ElementInfo& info = Queue<SamplingType>::info(buffers[channel]);
+				info = ElementInfo();
+				info.lostFrames = pendingLostFrames;
+				info.captureTime = captureTime;
+			}
+			pendingLostFrames = 0;
+		}
+
+		::snd_pcm_uframes_t frames = std::min(available, elementSize - fill);
+		::snd_pcm_sframes_t result = useMmap
+				? readMmap(frames, buffers, fill)
+				: read(frames, buffers, fill);
+		if (result < 0) {
+			return result;
+		}
+
+		fill += result;
+		available -= result;
+		if (fill == elementSize) {
+			for (unsigned channel = 0; channel < channels; channel++) {
+				queues[channel]->push_back(buffers[channel]);
+				buffers[channel] = nullptr;
+			}
+			captureLatencyHistogram.record(
+					std::chrono::steady_clock::now() - captureStart);
+			fill = 0;
+		}
+	}
+	return 0;
+}
+
+bool
+Alsa::
+isXrun(int error)
+{
+	return error == -EPIPE || error == -ESTRPIPE;
+}
+
+/**
+ * Restarts the device after an overrun (or a suspend). The frames which
+ * were in the driver's buffer and the frames which arrived until the
+ * restart are lost, as are the frames in the partially filled elements,
+ * which would span the gap otherwise. The elements themselves are kept and
+ * filled again from the start, they never go back to the pool from here
+ * (only the consumer releases to it).
+ */
+bool
+Alsa::
+recover(int error, ::snd_pcm_uframes_t& fill)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// time since the overrun happened, according to the driver
+	std::chrono::microseconds sinceXrun(0);
+	::snd_pcm_status_t* status;
+	if (::snd_pcm_status_malloc(&status) == 0) {
+		if (::snd_pcm_status(pcmHandle, status) == 0) {
+			::snd_timestamp_t now, trigger;
+			::snd_pcm_status_get_tstamp(status, &now);
+			::snd_pcm_status_get_trigger_tstamp(status, &trigger);
+			sinceXrun = std::chrono::seconds(now.tv_sec - trigger.tv_sec)
+					+ std::chrono::microseconds(now.tv_usec - trigger.tv_usec);
 		}
+		::snd_pcm_status_free(status);
+	}
+
+	int result = ::snd_pcm_recover(pcmHandle, error, 1);
+	if (result < 0) {
+		std::ostringstream oss;
+		oss << "failed to recover from overrun: " << ::snd_strerror(result);
+		LOGGER_ERROR(oss.str());
+		return false;
+	}
 
-		result = ::snd_pcm_readi(pcmHandle, buffer, periodSize);
+	// Unlike playback, capture does not start by itself after prepare. After
+	// a suspend (-ESTRPIPE) the device may have been resumed and be running
+	// already, starting it again would fail.
+	if (::snd_pcm_state(pcmHandle) == SND_PCM_STATE_PREPARED) {
+		result = ::snd_pcm_start(pcmHandle);
 		if (result < 0) {
-			queue.release(buffer);
 			std::ostringstream oss;
-			oss << "error while reading from device: " << ::snd_strerror(result);
+			oss << "failed to restart device: " << ::snd_strerror(result);
 			LOGGER_ERROR(oss.str());
-			break;
+			return false;
 		}
+	}
 
-		queue.push_back(buffer);
+	auto recoveryTime = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now() - start);
+	if (sinceXrun < std::chrono::microseconds(0)) {
+		sinceXrun = std::chrono::microseconds(0);
 	}
 
-	result = ::snd_pcm_drop(pcmHandle);
+	uint64_t lost = bufferSize + fill
+			+ (sinceXrun + recoveryTime).count() * samplingRate / 1000000;
+	fill = 0;
+	pendingLostFrames += lost;
+
+	xruns++;
+	lostFrames += lost;
+	auto max = maxRecoveryTime.load();
+	while (recoveryTime.count() > max && !maxRecoveryTime.compare_exchange_weak(
+			max, recoveryTime.count())) {
+	}
+
+	LOGGER_WARNING("overrun (" << ::snd_strerror(error) << "): about " << lost
+			<< " frames lost, recovered in " << recoveryTime.count() << " [us]");
+	return true;
+}
+
+const Histogram&
+Alsa::
+captureLatencies() const
+{
+	return captureLatencyHistogram;
+}
+
+void
+Alsa::
+getStats(unsigned& xruns, uint64_t& lostFrames,
+		std::chrono::microseconds& maxRecoveryTime,
+		std::chrono::microseconds& meanWakeupLatency,
+		std::chrono::microseconds& maxWakeupLatency)
+{
+	xruns = this->xruns.exchange(0);
+	lostFrames = this->lostFrames.exchange(0);
+	maxRecoveryTime = std::chrono::microseconds(this->maxRecoveryTime.exchange(0));
+	unsigned wakeups = this->wakeups.exchange(0);
+	long long latency = totalWakeupLatency.exchange(0);
+	meanWakeupLatency = std::chrono::microseconds(
+			wakeups > 0 ? latency / wakeups : 0);
+	maxWakeupLatency = std::chrono::microseconds(
+			this->maxWakeupLatency.exchange(0));
+}
+
+/**
+ * Records the time from the last update of the hardware pointer (the
+ * interrupt which made the period available) until the capture thread got
+ * to run, which is the scheduling latency the thread suffers. Devices
+ * without timestamps (some plugins) report none, they are not counted.
+ */
+void
+Alsa::
+measureWakeup()
+{
+	::snd_pcm_uframes_t available;
+	::snd_htimestamp_t timestamp;
+	if (::snd_pcm_htimestamp(pcmHandle, &available, &timestamp) < 0
+			|| (timestamp.tv_sec == 0 && timestamp.tv_nsec == 0)) {
+		return;
+	}
+	// steady_clock is CLOCK_MONOTONIC, the timestamp type set in initParams
+	auto update = std::chrono::seconds(timestamp.tv_sec)
+			+ std::chrono::nanoseconds(timestamp.tv_nsec);
+	long long latency = std::chrono::duration_cast<std::chrono::microseconds>(
+			std::chrono::steady_clock::now().time_since_epoch() - update).count();
+	if (latency < 0) {
+		return;
+	}
+
+	wakeups++;
+	totalWakeupLatency += latency;
+	auto max = maxWakeupLatency.load();
+	while (latency > max && !maxWakeupLatency.compare_exchange_weak(
+			max, latency)) {
+	}
+}
+
+/**
+ * \return  the number of frames read (at most `frames`) or a negative
+ *          error code
+ */
+::snd_pcm_sframes_t
+Alsa::
+readMmap(::snd_pcm_uframes_t frames, std::vector<SamplingType*>& buffers,
+		::snd_pcm_uframes_t fill)
+{
+	const ::snd_pcm_channel_area_t* areas;
+	::snd_pcm_uframes_t offset;
+	int result = ::snd_pcm_mmap_begin(pcmHandle, &areas, &offset, &frames);
 	if (result < 0) {
+		if (isXrun(result)) {
+			return result;
+		}
 		std::ostringstream oss;
-		oss << "failed to drop device: " << ::snd_strerror(result);
+		oss << "failed to access mmap area: " << ::snd_strerror(result);
 		LOGGER_ERROR(oss.str());
+		return result;
 	}
 
-	LOGGER_INFO("alsa thread exiting");
+	// first and step of the areas are in bits
+	for (unsigned channel = 0; channel < channels; channel++) {
+		const ::snd_pcm_channel_area_t& area = areas[channel];
+		const uint8_t* source = (const uint8_t*) area.addr
+				+ (area.first + offset * area.step) / 8;
+		convert(source, area.step / 8, buffers[channel] + fill, frames);
+	}
+
+	::snd_pcm_sframes_t committed = ::snd_pcm_mmap_commit(pcmHandle, offset,
+			frames);
+	if (committed < 0 && isXrun(committed)) {
+		return committed;
+	} else if (committed < 0 || (::snd_pcm_uframes_t) committed != frames) {
+		std::ostringstream oss;
+		oss << "failed to commit mmap area: "
+			<< (committed < 0 ? ::snd_strerror(committed) : "short commit");
+		LOGGER_ERROR(oss.str());
+		return committed < 0 ? committed : -EIO;
+	}
+	return committed;
+}
+
+/**
+ * The frames go through the interleaved buffer (at most one period at a
+ * time), from which they are converted into the queue elements.
+ *
+ * \return  the number of frames read (at most `frames`) or a negative
+ *          error code
+ */
+::snd_pcm_sframes_t
+Alsa::
+read(::snd_pcm_uframes_t frames, std::vector<SamplingType*>& buffers,
+		::snd_pcm_uframes_t fill)
+{
+	::snd_pcm_sframes_t result = ::snd_pcm_readi(pcmHandle, interleaved.data(),
+			std::min(frames, periodSize));
+	if (result < 0) {
+		if (isXrun(result)) {
+			return result;
+		}
+		std::ostringstream oss;
+		oss << "error while reading from device: " << ::snd_strerror(result);
+		LOGGER_ERROR(oss.str());
+		return result;
+	}
+
+	deinterleave(interleaved.data(), result, buffers, fill);
+	return result;
+}
+
+/**
+ * Gets one element for every channel which has none yet. The elements
+ * already allocated are kept when a queue is empty (handing them back
+ * with release() would race with the consumer), the next call only
+ * allocates the missing ones.
+ *
+ * \return  whether there is an element for every channel
+ */
+bool
+Alsa::
+allocate(std::vector<SamplingType*>& buffers)
+{
+	for (unsigned channel = 0; channel < channels; channel++) {
+		if (buffers[channel] == nullptr) {
+			buffers[channel] = queues[channel]->allocate();
+			if (buffers[channel] == nullptr) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * Gives the elements still held back to their queues, from the producer
+ * side.
+ */
+void
+Alsa::
+unallocate(std::vector<SamplingType*>& buffers)
+{
+	for (unsigned channel = 0; channel < channels; channel++) {
+		if (buffers[channel] != nullptr) {
+			queues[channel]->unallocate(buffers[channel]);
+			buffers[channel] = nullptr;
+		}
+	}
+}
+
+void
+Alsa::
+deinterleave(const uint8_t* frames, ::snd_pcm_uframes_t count,
+		const std::vector<SamplingType*>& buffers, ::snd_pcm_uframes_t fill)
+{
+	unsigned size = sampleSize(format);
+	for (unsigned channel = 0; channel < channels; channel++) {
+		convert(frames + channel * size, frameSize, buffers[channel] + fill,
+				count);
+	}
 }
 
 } // namespace
@@ -7,18 +7,23 @@
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <vector>
 
 #include <alsa/asoundlib.h>
 
+#include "utils/histogram.h"
 #include "utils/logger.h"
 #include "utils/queue.h"
+#include "utils/realtime.h"
+#include "utils/statistics.h"
+#include "sample_format.h"
 #include "defs.h"
 
 namespace ockl {
 
 /**
  * Notes about how ALSA works:
- *  sampling size = sampling format = 2 bytes (S16_LE = 16 bit little endian)
+ *  sampling size = size of the sampling format, e.g. 3 bytes for S24_3LE
  *  frame size = {sampling size} * #channels
  *  period size = {frame size} * {#frames between hardware interrupts}
  *  period time = time between hardware interrupts
@@ -26,33 +31,124 @@ namespace ockl {
  *  input latency = {#frames in period} * {length of frame}, length of frame is {sampling rate}^{-1}
  */
 
-class Alsa {
+/**
+ * Captures one queue per channel: the interleaved frames read from the
+ * device are split up into the elements of the channel queues.
+ *
+ * The period size of the device is independent of the size of the queue
+ * elements. Frames are taken from the device as soon as they are available
+ * and collected in the current queue elements, which are pushed once full.
+ * Thus a small period (low latency, supported by most devices) can feed
+ * large elements, and large elements are assembled from many periods.
+ *
+ * In mmap mode the frames are copied straight out of the driver's buffer
+ * (the DMA area for hardware devices) into the queue elements, instead of
+ * being copied into an intermediate buffer by snd_pcm_readi first.
+ *
+ * The sample format is negotiated with the device at runtime, the first of
+ * the given formats it supports is taken. The samples are converted to
+ * SamplingType on the way into the queue elements, by a converter chosen
+ * once for the format.
+ *
+ * Overruns are recovered from by restarting the device. The element pushed
+ * after an overrun carries the (estimated) number of lost frames in its
+ * ElementInfo, and the overruns are counted for the Watchdog, along with
+ * the wakeup latency of the capture thread.
+ */
+class Alsa : public CaptureStatistics {
 public:
+	/**
+	 * \param periodSize  requested period size of the device [frames], the
+	 *                    driver might choose a different one
+	 * \param useMmap     use mmap access instead of snd_pcm_readi, not every
+	 *                    device supports this
+	 * \param formats     sample formats to try, in the order of preference
+	 * \param threadSettings  scheduling of the capture thread
+	 * \param queues      one queue per channel to capture, all with the
+	 *                    same element size
+	 */
 	Alsa(const std::string& deviceName,
 			unsigned samplingRate,
 			unsigned periodSize,
-			Queue<SamplingType>& queue,
+			bool useMmap,
+			const std::vector<SampleFormat>& formats,
+			const ThreadSettings& threadSettings,
+			const std::vector<Queue<SamplingType>*>& queues,
 			const Logger& logger);
-	~Alsa();
+	~Alsa() override;
 
 	void init();
 	void start();
 	void shutdown();
 
+	/**
+	 * Distribution of the time from the capture of the first frame of an
+	 * element until the element is pushed into the queues.
+	 */
+	const Histogram& captureLatencies() const;
+
+	void getStats(unsigned& xruns,
+			uint64_t& lostFrames,
+			std::chrono::microseconds& maxRecoveryTime,
+			std::chrono::microseconds& meanWakeupLatency,
+			std::chrono::microseconds& maxWakeupLatency) override;
+
 private:
 	void initParams();
+	void initFormat(::snd_pcm_hw_params_t* params);
 	void printInfo(::snd_pcm_hw_params_t *params);
 	void threadFunction();
+	void measureWakeup();
+	int capture(::snd_pcm_uframes_t available,
+			std::vector<SamplingType*>& buffers, ::snd_pcm_uframes_t& fill);
+	::snd_pcm_sframes_t readMmap(::snd_pcm_uframes_t frames,
+			std::vector<SamplingType*>& buffers, ::snd_pcm_uframes_t fill);
+	::snd_pcm_sframes_t read(::snd_pcm_uframes_t frames,
+			std::vector<SamplingType*>& buffers, ::snd_pcm_uframes_t fill);
+	static bool isXrun(int error);
+	bool recover(int error, ::snd_pcm_uframes_t& fill);
+	bool allocate(std::vector<SamplingType*>& buffers);
+	void unallocate(std::vector<SamplingType*>& buffers);
+	void deinterleave(const uint8_t* frames, ::snd_pcm_uframes_t count,
+			const std::vector<SamplingType*>& buffers,
+			::snd_pcm_uframes_t fill);
 
 	::snd_pcm_t* pcmHandle;
 	const std::string deviceName;
 
 	unsigned samplingRate;
 	::snd_pcm_uframes_t periodSize;
-	static const snd_pcm_format_t samplingFormat = SND_PCM_FORMAT_S16_LE;
-
-	Queue<SamplingType>& queue;
-
+	::snd_pcm_uframes_t elementSize;
+	bool useMmap;
+	std::vector<SampleFormat> formats;
+	SampleFormat format;
+	SampleConverter convert;
+	// bytes per frame
+	unsigned frameSize;
+	std::vector<uint8_t> interleaved;
+
+	std::vector<Queue<SamplingType>*> queues;
+	unsigned channels;
+
+	::snd_pcm_uframes_t bufferSize;
+	uint64_t pendingLostFrames;
+	std::atomic<unsigned> xruns;
+	std::atomic<uint64_t> lostFrames;
+	std::atomic<long long> maxRecoveryTime;
+	/**
+	 * frames were left in the driver, the next wakeup is immediate
+	 */
+	bool deferred;
+	std::atomic<unsigned> wakeups;
+	std::atomic<long long> totalWakeupLatency;
+	std::atomic<long long> maxWakeupLatency;
+	/**
+	 * when the first frame of the current elements was captured
+	 */
+	std::chrono::steady_clock::time_point captureStart;
+	Histogram captureLatencyHistogram;
+
+	ThreadSettings threadSettings;
 	const Logger& logger;
 
 	std::thread* thread;
@@ -0,0 +1,233 @@
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "audio_file.h"
+
+namespace ockl {
+
+namespace {
+
+const uint16_t WavePcm = 1;
+const uint16_t WaveFloat = 3;
+const uint16_t WaveExtensible = 0xfffe;
+
+// The files are little endian, just like the machines we run on.
+template <typename T>
+T
+load(const uint8_t* source)
+{
+	T value;
+	memcpy(&value, source, sizeof(T));
+	return value;
+}
+
+} // namespace
+
+AudioFile::
+AudioFile(const std::string& fileName, const Logger& logger)
+: fileName(fileName),
+  fd(-1),
+  mapping(nullptr),
+  mappingSize(0),
+  data(nullptr),
+  format(SampleFormat::S16),
+  sampleSize(0),
+  channels(0),
+  samplingRate(0),
+  frames(0),
+  logger(logger)
+{
+}
+
+AudioFile::
+~AudioFile()
+{
+	if (mapping != nullptr) {
+		::munmap((void*) mapping, mappingSize);
+	}
+	if (fd >= 0) {
+		::close(fd);
+	}
+}
+
+void
+AudioFile::
+open()
+{
+	map();
+	parseWav();
+}
+
+void
+AudioFile::
+open(SampleFormat format, unsigned channels, unsigned samplingRate)
+{
+	if (channels == 0) {
+		throw std::runtime_error("at least one channel is needed");
+	}
+
+	map();
+	this->format = format;
+	this->sampleSize = ockl::sampleSize(format);
+	this->channels = channels;
+	this->samplingRate = samplingRate;
+	data = mapping;
+	frames = mappingSize / (sampleSize * channels);
+
+	LOGGER_INFO(fileName << ": raw " << sampleFormatName(format) << ", "
+			<< channels << " channels, " << frames << " frames");
+}
+
+unsigned
+AudioFile::
+getSamplingRate() const
+{
+	return samplingRate;
+}
+
+unsigned
+AudioFile::
+getChannels() const
+{
+	return channels;
+}
+
+uint64_t
+AudioFile::
+getFrames() const
+{
+	return frames;
+}
+
+void
+AudioFile::
+read(uint64_t frame, unsigned channel, SamplingType* destination,
+		unsigned count) const
+{
+	unsigned step = sampleSize * channels;
+	const uint8_t* source = data + frame * step + channel * sampleSize;
+	sampleConverter(format)(source, step, destination, count);
+}
+
+void
+AudioFile::
+map()
+{
+	if (mapping != nullptr) {
+		throw std::runtime_error("file already opened");
+	}
+
+	fd = ::open(fileName.c_str(), O_RDONLY);
+	if (fd < 0) {
+		std::ostringstream oss;
+		oss << "failed to open " << fileName << ": " << strerror(errno);
+		throw std::runtime_error(oss.str());
+	}
+
+	struct stat status;
+	if (::fstat(fd, &status) < 0) {
+		std::ostringstream oss;
+		oss << "failed to stat " << fileName << ": " << strerror(errno);
+		throw std::runtime_error(oss.str());
+	}
+	mappingSize = status.st_size;
+	if (mappingSize == 0) {
+		throw std::runtime_error(fileName + " is empty");
+	}
+
+	void* address = ::mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (address == MAP_FAILED) {
+		std::ostringstream oss;
+		oss << "failed to map " << fileName << ": " << strerror(errno);
+		throw std::runtime_error(oss.str());
+	}
+	mapping = (const uint8_t*) address;
+
+	// The file is read front to back exactly once.
+	::madvise(address, mappingSize, MADV_SEQUENTIAL);
+}
+
+void
+AudioFile::
+parseWav()
+{
+	const uint8_t* end = mapping + mappingSize;
+	if (mappingSize < 12 || memcmp(mapping, "RIFF", 4) != 0
+			|| memcmp(mapping + 8, "WAVE", 4) != 0) {
+		throw std::runtime_error(fileName + " is not a WAV file");
+	}
+
+	bool haveFormat = false;
+	const uint8_t* chunk = mapping + 12;
+	while (chunk + 8 <= end) {
+		uint32_t chunkSize = load<uint32_t>(chunk + 4);
+		const uint8_t* body = chunk + 8;
+
+		if (memcmp(chunk, "fmt ", 4) == 0) {
+			if (chunkSize < 16 || body + chunkSize > end) {
+				throw std::runtime_error(fileName + ": invalid fmt chunk");
+			}
+			uint16_t tag = load<uint16_t>(body);
+			channels = load<uint16_t>(body + 2);
+			samplingRate = load<uint32_t>(body + 4);
+			unsigned bits = load<uint16_t>(body + 14);
+			if (tag == WaveExtensible && chunkSize >= 40) {
+				// the first two bytes of the sub format guid are the tag
+				tag = load<uint16_t>(body + 24);
+			}
+
+			if (tag == WavePcm && bits == 16) {
+				format = SampleFormat::S16;
+			} else if (tag == WavePcm && bits == 24) {
+				format = SampleFormat::S24;
+			} else if (tag == WavePcm && bits == 32) {
+				format = SampleFormat::S32;
+			} else if (tag == WaveFloat && bits == 32) {
+				format = SampleFormat::Float;
+			} else {
+				std::ostringstream oss;
+				oss << fileName << ": unsupported format " << tag << " with "
+						<< bits << " bits per sample";
+				throw std::runtime_error(oss.str());
+			}
+			if (channels == 0) {
+				throw std::runtime_error(fileName + ": no channels");
+			}
+			sampleSize = bits / 8;
+			haveFormat = true;
+		} else if (memcmp(chunk, "data", 4) == 0) {
+			if (!haveFormat) {
+				throw std::runtime_error(fileName + ": data before fmt chunk");
+			}
+			// Recorders which were interrupted leave the size at 0 or at
+			// 0xffffffff, so take whatever is there.
+			uint64_t size = std::min<uint64_t>(chunkSize, end - body);
+			if (chunkSize == 0) {
+				size = end - body;
+			}
+			data = body;
+			frames = size / (sampleSize * channels);
+
+			LOGGER_INFO(fileName << ": wav " << sampleFormatName(format) << ", "
+					<< channels << " channels, " << samplingRate << " [Hz], "
+					<< frames << " frames");
+			return;
+		}
+
+		// chunks are padded to an even size
+		chunk = body + chunkSize + (chunkSize & 1);
+	}
+
+	throw std::runtime_error(fileName + ": no data chunk");
+}
+
+} // namespace
@@ -0,0 +1,74 @@
+
+#ifndef __AUDIO_FILE__H
+#define __AUDIO_FILE__H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#include "utils/logger.h"
+#include "sample_format.h"
+#include "defs.h"
+
+namespace ockl {
+
+/**
+ * A recording, mapped into memory as a whole. WAV files (PCM 16/24/32 bit or
+ * IEEE float 32 bit) describe themselves, headerless raw files need their
+ * format, channel count and sampling rate from the caller.
+ */
+class AudioFile {
+public:
+	AudioFile(const std::string& fileName, const Logger& logger);
+	~AudioFile();
+
+	AudioFile(const AudioFile&) = delete;
+	AudioFile& operator=(const AudioFile&) = delete;
+
+	/**
+	 * Opens a WAV file.
+	 * \throws std::runtime_error if the file cannot be mapped or is not a
+	 *         supported WAV file
+	 */
+	void open();
+
+	/**
+	 * Opens a headerless file of interleaved frames.
+	 * \throws std::runtime_error if the file cannot be mapped
+	 */
+	void open(SampleFormat format, unsigned channels, unsigned samplingRate);
+
+	unsigned getSamplingRate() const;
+	unsigned getChannels() const;
+	uint64_t getFrames() const;
+
+	/**
+	 * Converts `count` samples of one channel, starting at frame `frame`,
+	 * to SamplingType.
+	 */
+	void read(uint64_t frame, unsigned channel, SamplingType* destination,
+			unsigned count) const;
+
+private:
+	void map();
+	void parseWav();
+
+	const std::string fileName;
+
+	int fd;
+	const uint8_t* mapping;
+	std::size_t mappingSize;
+
+	const uint8_t* data;
+	SampleFormat format;
+	unsigned sampleSize;
+	unsigned channels;
+	unsigned samplingRate;
+	uint64_t frames;
+
+	const Logger& logger;
+};
+
+} // namespace
+
+#endif
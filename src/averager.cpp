@@ -0,0 +1,285 @@
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "averager.h"
+
+namespace ockl {
+
+AveragingSettings
+parseAveraging(const std::string& name)
+{
+	std::string mode = name.substr(0, name.find(':'));
+	std::string parameter = mode.size() < name.size()
+			? name.substr(mode.size() + 1) : "";
+
+	AveragingSettings settings{Averaging::None, 1, 1.0};
+	if (mode == "none" || mode == "cumulative" || mode == "max-hold"
+			|| mode == "min-hold") {
+		if (!parameter.empty()) {
+			throw std::runtime_error(mode + " takes no parameter");
+		}
+		settings.mode = mode == "none" ? Averaging::None
+				: mode == "cumulative" ? Averaging::Cumulative
+				: mode == "max-hold" ? Averaging::MaxHold
+				: Averaging::MinHold;
+	} else if (mode == "linear") {
+		settings.mode = Averaging::Linear;
+		// stoul would take "-1" for the largest value
+		if (parameter.find('-') != std::string::npos) {
+			throw std::runtime_error("linear averaging needs a positive frame count");
+		}
+		unsigned long frames = std::stoul(parameter);
+		if (frames == 0 || frames > MaxAveragingFrames) {
+			std::ostringstream message;
+			message << "linear averaging needs 1 to " << MaxAveragingFrames
+					<< " frames";
+			throw std::runtime_error(message.str());
+		}
+		settings.frames = frames;
+	} else if (mode == "exponential") {
+		settings.mode = Averaging::Exponential;
+		settings.alpha = std::stod(parameter);
+		if (settings.alpha <= 0 || settings.alpha > 1) {
+			throw std::runtime_error("alpha must be in the range (0, 1]");
+		}
+	} else {
+		throw std::runtime_error("unknown averaging " + name);
+	}
+	return settings;
+}
+
+std::string
+averagingName(const AveragingSettings& settings)
+{
+	std::ostringstream oss;
+	switch (settings.mode) {
+	case Averaging::None:
+		oss << "none";
+		break;
+	case Averaging::Linear:
+		oss << "linear:" << settings.frames;
+		break;
+	case Averaging::Exponential:
+		oss << "exponential:" << settings.alpha;
+		break;
+	case Averaging::Cumulative:
+		oss << "cumulative";
+		break;
+	case Averaging::MaxHold:
+		oss << "max-hold";
+		break;
+	case Averaging::MinHold:
+		oss << "min-hold";
+		break;
+	}
+	return oss.str();
+}
+
+Averager::
+Averager(const AveragingSettings& settings,
+		Scale scale,
+		const std::vector<double>& calibration,
+		bool lossless,
+		Queue<SpectrumType>& inQueue,
+		Queue<SpectrumType>& outQueue,
+		const Logger& logger)
+: settings(settings),
+  scale(scale),
+  calibration(calibration.begin(), calibration.end()),
+  lossless(lossless),
+  binCount(inQueue.getElementSize()),
+  history(settings.mode == Averaging::Linear
+		  ? (std::size_t) settings.frames * binCount : 0),
+  next(0),
+  count(0),
+  state(binCount),
+  inQueue(inQueue),
+  outQueue(outQueue),
+  logger(logger),
+  thread(nullptr),
+  doShutdown(false)
+{
+}
+
+Averager::
+~Averager()
+{
+	if (thread != nullptr) {
+		doShutdown = true;
+		thread->join();
+		delete thread;
+		thread = nullptr;
+	}
+}
+
+void
+Averager::
+start()
+{
+	LOGGER_INFO("averaging: " << averagingName(settings));
+	thread = new std::thread(&Averager::threadFunction, this);
+	pthread_setname_np(thread->native_handle(), "averager");
+}
+
+void
+Averager::
+shutdown()
+{
+	doShutdown = true;
+}
+
+void
+Averager::
+threadFunction()
+{
+	while (!doShutdown) {
+		SpectrumType* power = inQueue.pop_front();
+		if (power == nullptr) {
+			continue;
+		}
+
+		const ElementInfo& info = Queue<SpectrumType>::info(power);
+		if (info.lostFrames > 0 && settings.mode == Averaging::Linear) {
+			reset();
+		}
+		if (!info.endOfStream) {
+			add(power);
+		}
+
+		// end of stream markers must not get lost
+		SpectrumType* spectrum = outQueue.allocate();
+		while (spectrum == nullptr && (lossless || info.endOfStream)
+				&& !doShutdown) {
+			spectrum = outQueue.allocate();
+		}
+		if (spectrum != nullptr) {
+			Queue<SpectrumType>::info(spectrum) = info;
+			finish(spectrum);
+			outQueue.push_back(spectrum);
+		}
+
+		inQueue.release(power);
+	}
+}
+
+/**
+ * Scales the state (the sum for Linear) and converts it to the scale.
+ */
+void
+Averager::
+finish(SpectrumType* __restrict spectrum)
+{
+	const SpectrumType* __restrict average = state.data();
+	SpectrumType factor = settings.mode == Averaging::Linear
+			? 1.0 / std::max<uint64_t>(1, count) : 1.0;
+	if (!calibration.empty()) {
+		const SpectrumType* __restrict factors = calibration.data();
+		for (unsigned i = 0; i < binCount; i++) {
+			spectrum[i] = average[i] * factor * factors[i];
+		}
+		average = spectrum;
+	} else if (settings.mode == Averaging::Linear) {
+		for (unsigned i = 0; i < binCount; i++) {
+			spectrum[i] = average[i] * factor;
+		}
+		average = spectrum;
+	}
+	convertPower(average, spectrum, binCount, scale);
+}
+
+void
+Averager::
+reset()
+{
+	count = 0;
+	next = 0;
+	std::fill(state.begin(), state.end(), 0.0);
+}
+
+/**
+ * Folds one power spectrum into the state. The loops are kept simple (no
+ * branches, no aliasing) so the compiler vectorizes them.
+ */
+void
+Averager::
+add(const SpectrumType* __restrict power)
+{
+	SpectrumType* __restrict average = state.data();
+	unsigned bins = binCount;
+
+	if (count == 0 && settings.mode != Averaging::Linear) {
+		std::copy(power, power + bins, average);
+		count = 1;
+		return;
+	}
+
+	switch (settings.mode) {
+	case Averaging::None:
+		std::copy(power, power + bins, average);
+		break;
+	case Averaging::Linear: {
+		// a running sum: add the new spectrum, subtract the one which
+		// falls out of the window
+		SpectrumType* __restrict oldest = history.data()
+				+ (std::size_t) next * bins;
+		if (count < settings.frames) {
+			for (unsigned i = 0; i < bins; i++) {
+				average[i] += power[i];
+			}
+			count++;
+		} else {
+			for (unsigned i = 0; i < bins; i++) {
+				average[i] += power[i] - oldest[i];
+			}
+		}
+		std::copy(power, power + bins, oldest);
+		next = (next + 1) % settings.frames;
+
+		// The subtractions leave rounding errors of the size of the
+		// largest values, which would swamp quiet bins after a loud
+		// burst. Summing up again once per round cancels them.
+		if (next == 0 && count == settings.frames) {
+			std::copy(history.data(), history.data() + bins, average);
+			for (unsigned frame = 1; frame < settings.frames; frame++) {
+				const SpectrumType* __restrict values = history.data()
+						+ (std::size_t) frame * bins;
+				for (unsigned i = 0; i < bins; i++) {
+					average[i] += values[i];
+				}
+			}
+		}
+		break;
+	}
+	case Averaging::Exponential: {
+		SpectrumType alpha = settings.alpha;
+		for (unsigned i = 0; i < bins; i++) {
+			average[i] += alpha * (power[i] - average[i]);
+		}
+		break;
+	}
+	case Averaging::Cumulative: {
+		// the running mean instead of the sum, which would grow without
+		// bound over a long measurement
+		count++;
+		SpectrumType weight = 1.0 / count;
+		for (unsigned i = 0; i < bins; i++) {
+			average[i] += weight * (power[i] - average[i]);
+		}
+		break;
+	}
+	case Averaging::MaxHold:
+		for (unsigned i = 0; i < bins; i++) {
+			average[i] = std::max(average[i], power[i]);
+		}
+		break;
+	case Averaging::MinHold:
+		for (unsigned i = 0; i < bins; i++) {
+			average[i] = std::min(average[i], power[i]);
+		}
+		break;
+	}
+}
+
+} // namespace
@@ -0,0 +1,126 @@
+
+#ifndef __AVERAGER__H
+#define __AVERAGER__H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/logger.h"
+#include "utils/queue.h"
+#include "spectrum.h"
+
+namespace ockl {
+
+enum class Averaging {
+	None,
+	/**
+	 * mean of the last `frames` spectra
+	 */
+	Linear,
+	/**
+	 * average += alpha * (spectrum - average)
+	 */
+	Exponential,
+	/**
+	 * mean of all spectra since the start, in constant memory:
+	 * average += (spectrum - average) / count
+	 */
+	Cumulative,
+	MaxHold,
+	MinHold
+};
+
+/**
+ * upper bound for the frames of Linear, its history holds that many spectra
+ */
+const unsigned MaxAveragingFrames = 10000;
+
+struct AveragingSettings {
+	Averaging mode;
+	unsigned frames;
+	double alpha;
+};
+
+/**
+ * Parses "linear:<frames>", "exponential:<alpha>", "cumulative",
+ * "max-hold", "min-hold" or "none".
+ * \throws std::runtime_error for an unknown mode or an invalid parameter
+ */
+AveragingSettings parseAveraging(const std::string& name);
+
+std::string averagingName(const AveragingSettings& settings);
+
+/**
+ * Averages the spectra between the Fft and the ui. The input spectra must
+ * be power spectra (Scale::Power), so that the average is one of power and
+ * not of decibels, the output is converted to `scale`.
+ *
+ * All buffers are allocated up front, every spectrum is folded into the
+ * running state in place. A gap in the input (lost frames) restarts the
+ * Linear window, which is meant to show the last `frames` consecutive
+ * spectra; the other modes summarize the whole run and go on across it.
+ * The gap is passed on like everything else in ElementInfo.
+ */
+class Averager {
+public:
+	/**
+	 * \param calibration  factor per bin applied to the average before the
+	 *                     conversion to `scale`, see calibrationFactors(),
+	 *                     empty for none
+	 * \param lossless  wait for the output queue instead of dropping
+	 *                  spectra when it is full, see FftSettings
+	 */
+	Averager(const AveragingSettings& settings,
+			Scale scale,
+			const std::vector<double>& calibration,
+			bool lossless,
+			Queue<SpectrumType>& inQueue,
+			Queue<SpectrumType>& outQueue,
+			const Logger& logger);
+	~Averager();
+
+	void start();
+	void shutdown();
+
+private:
+	void threadFunction();
+	void reset();
+	void add(const SpectrumType* power);
+	void finish(SpectrumType* spectrum);
+
+	AveragingSettings settings;
+	Scale scale;
+	std::vector<SpectrumType> calibration;
+	bool lossless;
+	unsigned binCount;
+
+	/**
+	 * the last `frames` spectra for Linear, oldest at `next`
+	 */
+	std::vector<SpectrumType> history;
+	unsigned next;
+	/**
+	 * spectra in the average since the last reset, 64 bit so Cumulative can
+	 * run for good
+	 */
+	uint64_t count;
+	/**
+	 * sum of the history for Linear, the average otherwise
+	 */
+	std::vector<SpectrumType> state;
+
+	Queue<SpectrumType>& inQueue;
+	Queue<SpectrumType>& outQueue;
+
+	const Logger& logger;
+
+	std::thread* thread;
+	std::atomic<bool> doShutdown;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,94 @@
+
+#ifndef __BENCH__H
+#define __BENCH__H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace ockl {
+namespace bench {
+
+/**
+ * Minimal google-benchmark style runner: the function under test gets an
+ * iteration count and has to run its body that many times. The count is
+ * doubled until one run takes at least MinTime, then the run is repeated
+ * and the median time per iteration is reported.
+ */
+const std::chrono::milliseconds MinTime = std::chrono::milliseconds(200);
+const unsigned Repetitions = 5;
+
+struct Result {
+	double nsPerIteration;
+	double itemsPerSecond;
+	uint64_t iterations;
+};
+
+template <typename Function>
+double timeIterations(Function& function, uint64_t iterations)
+{
+	auto start = std::chrono::steady_clock::now();
+	function(iterations);
+	auto duration = std::chrono::steady_clock::now() - start;
+	return std::chrono::duration<double, std::nano>(duration).count();
+}
+
+/**
+ * \param itemsPerIteration  used to compute a throughput, e.g. the number
+ *                           of samples or bins processed per iteration
+ */
+template <typename Function>
+Result run(const std::string& name, Function function,
+		double itemsPerIteration = 1)
+{
+	uint64_t iterations = 1;
+	double ns = timeIterations(function, iterations);
+	while (ns < std::chrono::duration<double, std::nano>(MinTime).count()) {
+		iterations *= 2;
+		ns = timeIterations(function, iterations);
+	}
+
+	std::vector<double> samples{ns};
+	for (unsigned i = 1; i < Repetitions; i++) {
+		samples.push_back(timeIterations(function, iterations));
+	}
+	std::sort(samples.begin(), samples.end());
+
+	Result result;
+	result.iterations = iterations;
+	result.nsPerIteration = samples[samples.size() / 2] / iterations;
+	result.itemsPerSecond = itemsPerIteration * 1e9 / result.nsPerIteration;
+
+	std::cout << std::left << std::setw(40) << name << std::right
+			<< std::setw(14) << std::fixed << std::setprecision(1)
+			<< result.nsPerIteration << " ns"
+			<< std::setw(12) << result.iterations
+			<< std::setw(14) << std::setprecision(3)
+			<< result.itemsPerSecond / 1e6 << " M/s" << std::endl;
+	return result;
+}
+
+inline void header()
+{
+	std::cout << std::left << std::setw(40) << "benchmark" << std::right
+			<< std::setw(17) << "time" << std::setw(12) << "iterations"
+			<< std::setw(18) << "throughput" << std::endl;
+}
+
+/**
+ * Keeps the compiler from optimizing away a computed value.
+ */
+template <typename T>
+inline void doNotOptimize(const T& value)
+{
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+} // namespace
+} // namespace
+
+#endif
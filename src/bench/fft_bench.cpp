@@ -0,0 +1,86 @@
+
+#include <cstdlib>
+#include <sstream>
+
+#include <fftw3.h>
+
+#include "bench.h"
+
+/**
+ * Startup (planning) and per transform cost of the r2c transform used by
+ * Fft, for the different planner flags. Planning is timed twice: without
+ * any wisdom (what every start used to cost) and with the wisdom of the
+ * first run, which is what a start with a populated wisdom file costs.
+ *
+ * usage: fft_bench [max log2 size (default 20)] [max log2 size for patient
+ *                  planning (default 16)]
+ */
+
+struct Planner {
+	const char* name;
+	unsigned flags;
+};
+
+double
+planMilliseconds(unsigned size, double* in, fftw_complex* out, unsigned flags,
+		fftw_plan& plan)
+{
+	auto start = std::chrono::steady_clock::now();
+	plan = fftw_plan_dft_r2c_1d(size, in, out, flags | FFTW_DESTROY_INPUT);
+	return std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv)
+{
+	unsigned maxLog2 = argc > 1 ? atoi(argv[1]) : 20;
+	unsigned maxLog2Patient = argc > 2 ? atoi(argv[2]) : 16;
+
+	const Planner planners[] = {
+		{"estimate", FFTW_ESTIMATE},
+		{"measure", FFTW_MEASURE},
+		{"patient", FFTW_PATIENT},
+	};
+
+	ockl::bench::header();
+	for (unsigned log2 = 10; log2 <= maxLog2; log2++) {
+		unsigned size = 1u << log2;
+		double* in = (double*) fftw_malloc(sizeof(double) * size);
+		fftw_complex* out = (fftw_complex*) fftw_malloc(
+				sizeof(fftw_complex) * (size / 2 + 1));
+
+		for (const Planner& planner : planners) {
+			if (planner.flags == FFTW_PATIENT && log2 > maxLog2Patient) {
+				continue;
+			}
+
+			fftw_forget_wisdom();
+			fftw_plan plan;
+			double cold = planMilliseconds(size, in, out, planner.flags, plan);
+			fftw_destroy_plan(plan);
+			double warm = planMilliseconds(size, in, out, planner.flags, plan);
+
+			for (unsigned i = 0; i < size; i++) {
+				in[i] = (double) (rand() % 65536 - 32768);
+			}
+
+			std::ostringstream oss;
+			oss << "r2c/" << planner.name << "/" << size;
+			ockl::bench::run(oss.str(), [&](uint64_t iterations) {
+				for (uint64_t i = 0; i < iterations; i++) {
+					fftw_execute(plan);
+					ockl::bench::doNotOptimize(out[0][0]);
+				}
+			}, size);
+			std::cout << "    planning: " << std::setprecision(2) << cold
+					<< " ms without wisdom, " << warm << " ms with wisdom"
+					<< std::endl;
+
+			fftw_destroy_plan(plan);
+		}
+
+		fftw_free(in);
+		fftw_free(out);
+	}
+	return 0;
+}
@@ -0,0 +1,212 @@
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <fftw3.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "../window.h"
+
+/**
+ * What the precision of the fft path costs at large sizes: window the
+ * history, r2c transform and power of the bins, once with fftw in double
+ * and once with fftwf in float, independent of SINGLE_PRECISION. The
+ * throughput is in input samples. The working set (history, window, both
+ * fft buffers and the spectrum) is listed against the cache sizes, and if
+ * the kernel allows perf events the L1 data and last level cache read
+ * misses per sample are counted.
+ *
+ * usage: fft_precision_bench [largest log2 size (default 22)]
+ */
+
+namespace {
+
+struct Double {
+	typedef double Real;
+	typedef fftw_complex Complex;
+	typedef fftw_plan Plan;
+	static constexpr const char* name = "double";
+
+	static void* allocate(std::size_t size) { return fftw_malloc(size); }
+	static void free(void* buffer) { fftw_free(buffer); }
+	static Plan plan(unsigned size, Real* in, Complex* out)
+	{
+		return fftw_plan_dft_r2c_1d(size, in, out,
+				FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
+	}
+	static void execute(Plan plan) { fftw_execute(plan); }
+	static void destroy(Plan plan) { fftw_destroy_plan(plan); }
+};
+
+struct Float {
+	typedef float Real;
+	typedef fftwf_complex Complex;
+	typedef fftwf_plan Plan;
+	static constexpr const char* name = "float";
+
+	static void* allocate(std::size_t size) { return fftwf_malloc(size); }
+	static void free(void* buffer) { fftwf_free(buffer); }
+	static Plan plan(unsigned size, Real* in, Complex* out)
+	{
+		return fftwf_plan_dft_r2c_1d(size, in, out,
+				FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
+	}
+	static void execute(Plan plan) { fftwf_execute(plan); }
+	static void destroy(Plan plan) { fftwf_destroy_plan(plan); }
+};
+
+/**
+ * A read miss counter of one cache level for the calling thread, invalid
+ * where perf events are not permitted (e.g. in containers).
+ */
+class MissCounter {
+public:
+	explicit MissCounter(uint64_t cache)
+	{
+		perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+				| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+	}
+
+	~MissCounter()
+	{
+		if (fd >= 0) {
+			close(fd);
+		}
+	}
+
+	bool valid() const { return fd >= 0; }
+
+	void start()
+	{
+		ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+		ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+	}
+
+	uint64_t stop()
+	{
+		ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		uint64_t count = 0;
+		if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+			return 0;
+		}
+		return count;
+	}
+
+private:
+	int fd;
+};
+
+/**
+ * \param bytes  as from sysconf, which returns 0 or -1 if it does not know
+ */
+std::string
+formatBytes(long bytes)
+{
+	std::ostringstream oss;
+	if (bytes <= 0) {
+		oss << "?";
+	} else if (bytes >= (1 << 20)) {
+		oss << bytes / (1 << 20) << " MiB";
+	} else {
+		oss << bytes / (1 << 10) << " KiB";
+	}
+	return oss.str();
+}
+
+template <typename Precision>
+void
+benchmark(unsigned size)
+{
+	typedef typename Precision::Real Real;
+	typedef typename Precision::Complex Complex;
+	unsigned binCount = size / 2 + 1;
+
+	std::vector<Real> history(size);
+	for (Real& sample : history) {
+		sample = (Real) (rand() % 2000 - 1000);
+	}
+	std::vector<double> coefficients = ockl::makeWindow(ockl::Window::Hann,
+			size);
+	std::vector<Real> table(coefficients.begin(), coefficients.end());
+	std::vector<Real> spectrum(binCount);
+	Real* in = (Real*) Precision::allocate(sizeof(Real) * size);
+	Complex* out = (Complex*) Precision::allocate(sizeof(Complex) * binCount);
+	typename Precision::Plan plan = Precision::plan(size, in, out);
+
+	auto transform = [&](uint64_t iterations) {
+		for (uint64_t i = 0; i < iterations; i++) {
+			for (unsigned n = 0; n < size; n++) {
+				in[n] = history[n] * table[n];
+			}
+			Precision::execute(plan);
+			for (unsigned bin = 0; bin < binCount; bin++) {
+				spectrum[bin] = out[bin][0] * out[bin][0]
+						+ out[bin][1] * out[bin][1];
+			}
+			ockl::bench::doNotOptimize(spectrum[0]);
+		}
+	};
+
+	std::ostringstream name;
+	name << "fft/" << Precision::name << "/" << size;
+	ockl::bench::Result result = ockl::bench::run(name.str(), transform,
+			size);
+
+	uint64_t workingSet = (3 * size + binCount) * sizeof(Real)
+			+ binCount * sizeof(Complex);
+	std::cout << "    working set " << formatBytes(workingSet);
+	MissCounter l1(PERF_COUNT_HW_CACHE_L1D);
+	MissCounter llc(PERF_COUNT_HW_CACHE_LL);
+	if (l1.valid() && llc.valid()) {
+		l1.start();
+		llc.start();
+		transform(result.iterations);
+		double l1Misses = l1.stop();
+		double llcMisses = llc.stop();
+		double samples = (double) result.iterations * size;
+		std::cout << std::setprecision(4)
+				<< ", L1d read misses/sample " << l1Misses / samples
+				<< ", LLC read misses/sample " << llcMisses / samples;
+	} else {
+		std::cout << ", cache misses: perf events not available";
+	}
+	std::cout << std::endl;
+
+	Precision::destroy(plan);
+	Precision::free(in);
+	Precision::free(out);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	unsigned largest = argc > 1 ? atoi(argv[1]) : 22;
+
+	std::cout << "L1d " << formatBytes(sysconf(_SC_LEVEL1_DCACHE_SIZE))
+			<< ", L2 " << formatBytes(sysconf(_SC_LEVEL2_CACHE_SIZE))
+			<< ", L3 " << formatBytes(sysconf(_SC_LEVEL3_CACHE_SIZE))
+			<< std::endl;
+	ockl::bench::header();
+	for (unsigned log2 = 16; log2 <= largest; log2 += 2) {
+		benchmark<Double>(1u << log2);
+		benchmark<Float>(1u << log2);
+	}
+	return 0;
+}
@@ -0,0 +1,97 @@
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+#include "../utils/logger.h"
+#include "../utils/queue.h"
+#include "../fft.h"
+
+/**
+ * Spectra per second of one Fft with 1..N workers, fed as fast as possible
+ * from a producer thread, the output drained by a consumer thread.
+ *
+ * usage: fft_scaling_bench [log2 fft size (default 18)] [max workers
+ *                          (default number of cores)] [seconds per run]
+ */
+
+double
+spectraPerSecond(unsigned fftSize, unsigned workers, unsigned seconds,
+		const ockl::Logger& logger)
+{
+	ockl::Queue<ockl::SamplingType> inQueue(fftSize, 10, ockl::Timeout);
+	ockl::Queue<ockl::SpectrumType> outQueue(fftSize / 2 + 1, 10, ockl::Timeout);
+
+	ockl::FftSettings settings{fftSize, fftSize, ockl::Window::Hann,
+		ockl::Scale::Decibel, ockl::Planner::Estimate, "", workers, false,
+		ockl::ThreadSettings{0, {}}};
+	ockl::Fft fft(settings, inQueue, outQueue, logger);
+	fft.init();
+	fft.start();
+
+	std::atomic<bool> done(false);
+	std::thread producer([&] {
+		while (!done) {
+			ockl::SamplingType* buffer = inQueue.allocate();
+			if (buffer == nullptr) {
+				continue;
+			}
+			for (unsigned i = 0; i < fftSize; i++) {
+				buffer[i] = (ockl::SamplingType) (rand() % 2000 - 1000);
+			}
+			inQueue.push_back(buffer);
+		}
+	});
+
+	// let the pipeline fill up before counting
+	auto warmup = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+	while (std::chrono::steady_clock::now() < warmup) {
+		ockl::SpectrumType* spectrum = outQueue.pop_front();
+		if (spectrum != nullptr) {
+			outQueue.release(spectrum);
+		}
+	}
+
+	uint64_t count = 0;
+	auto start = std::chrono::steady_clock::now();
+	auto end = start + std::chrono::seconds(seconds);
+	while (std::chrono::steady_clock::now() < end) {
+		ockl::SpectrumType* spectrum = outQueue.pop_front();
+		if (spectrum != nullptr) {
+			outQueue.release(spectrum);
+			count++;
+		}
+	}
+	double elapsed = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+
+	done = true;
+	producer.join();
+	fft.shutdown();
+	return count / elapsed;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned log2 = argc > 1 ? atoi(argv[1]) : 18;
+	unsigned maxWorkers = argc > 2 ? atoi(argv[2])
+			: std::max(1u, std::thread::hardware_concurrency());
+	unsigned seconds = argc > 3 ? atoi(argv[3]) : 3;
+	unsigned fftSize = 1u << log2;
+
+	ockl::Logger logger;
+
+	double single = 0;
+	for (unsigned workers = 1; workers <= maxWorkers; workers++) {
+		double rate = spectraPerSecond(fftSize, workers, seconds, logger);
+		if (workers == 1) {
+			single = rate;
+		}
+		std::cout << "fft size " << fftSize << ", workers " << std::setw(2)
+				<< workers << ": " << std::fixed << std::setprecision(1)
+				<< std::setw(10) << rate << " spectra/s, speedup "
+				<< std::setprecision(2) << rate / single << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,254 @@
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "signal_source.h"
+#include "../utils/histogram.h"
+#include "../utils/logger.h"
+#include "../utils/queue.h"
+#include "../fft.h"
+
+/**
+ * End to end throughput and latency of the capture -> fft -> output path,
+ * headless: a SignalSource stands in for Alsa, an Fft transforms its
+ * elements and a null sink takes the spectra (like the UI or the file
+ * sink, without drawing or writing them).
+ *
+ * For every sampling rate and fft size it reports the sustained spectra
+ * per second, the input rate as a multiple of real time, the latency of
+ * the spectra (from the last sample of the hop being captured to the sink
+ * taking the spectrum) as p50/p99/p999/max, and the CPU time of the whole
+ * process in percent of one core.
+ *
+ * Unpaced (the default) measures the maximum throughput, the source
+ * waiting for the fft. Paced (-p) feeds in real time like a device, so the
+ * latency and CPU usage are those of a live analyzer, and frames lost to a
+ * pipeline which cannot keep up are counted.
+ *
+ * usage: pipeline_bench [-r <rates (default 48000,192000)>]
+ *                       [-n <log2 fft sizes (default 12,16,20)>]
+ *                       [-o <overlap [%] (default 0)>] [-j <workers>]
+ *                       [-s sine|noise|chirp (default chirp)]
+ *                       [-t <seconds per run (default 3)>] [-p]
+ *                       [-P estimate|measure|patient (default estimate)]
+ */
+
+namespace {
+
+struct Run {
+	unsigned samplingRate;
+	unsigned fftSize;
+	unsigned hopSize;
+	unsigned workers;
+	ockl::Planner planner;
+	ockl::bench::Signal signal;
+	bool paced;
+	unsigned seconds;
+};
+
+std::vector<unsigned>
+parseList(const std::string& value)
+{
+	std::vector<unsigned> values;
+	std::istringstream iss(value);
+	std::string item;
+	while (std::getline(iss, item, ',')) {
+		values.push_back(std::stoi(item));
+	}
+	if (values.empty()) {
+		throw std::runtime_error("empty list");
+	}
+	return values;
+}
+
+/**
+ * \return  user and system time of the process [s]
+ */
+double
+cpuTime()
+{
+	::rusage usage;
+	::getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6
+			+ usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+void
+benchmark(const Run& run, const ockl::Logger& logger)
+{
+	// as in main: one hop per capture element, the queues buffer as many
+	// samples as ten ffts
+	unsigned binCount = run.fftSize / 2 + 1;
+	ockl::Queue<ockl::SamplingType> inQueue(run.hopSize,
+			10 * run.fftSize / run.hopSize, ockl::Timeout);
+	ockl::Queue<ockl::SpectrumType> outQueue(binCount, 10, ockl::Timeout);
+
+	// Unpaced nothing may be dropped, otherwise the throughput would
+	// count spectra which were never computed.
+	ockl::FftSettings settings{run.fftSize, run.hopSize, ockl::Window::Hann,
+		ockl::Scale::Decibel, run.planner, "", run.workers, !run.paced,
+		ockl::ThreadSettings{0, {}}};
+	ockl::Fft fft(settings, inQueue, outQueue, logger);
+	ockl::bench::SignalSource source(run.signal, run.samplingRate, run.paced,
+			inQueue, logger);
+	fft.init();
+	fft.start();
+	source.start();
+
+	// The null sink, after a warmup for the fft and the caches. Paced, the
+	// first spectrum takes a whole fft length of input, and the run has to
+	// cover at least ten hops.
+	std::chrono::duration<double> hopTime((double) run.hopSize
+			/ run.samplingRate);
+	std::chrono::duration<double> fftTime((double) run.fftSize
+			/ run.samplingRate);
+	auto hopDuration = std::chrono::duration_cast<
+			std::chrono::system_clock::duration>(hopTime);
+	std::chrono::duration<double> warmupTime(0.5);
+	std::chrono::duration<double> measureTime(run.seconds);
+	if (run.paced) {
+		warmupTime = std::max(warmupTime, fftTime + hopTime);
+		measureTime = std::max(measureTime, 10 * hopTime);
+	}
+
+	ockl::Histogram latencies;
+	uint64_t count = 0;
+	uint64_t lostBefore = 0;
+	double cpuBefore = 0;
+	auto start = std::chrono::steady_clock::now();
+	auto warmup = start + std::chrono::duration_cast<
+			std::chrono::steady_clock::duration>(warmupTime);
+	auto end = warmup;
+	bool measuring = false;
+	while (true) {
+		auto now = std::chrono::steady_clock::now();
+		if (!measuring && now >= warmup) {
+			measuring = true;
+			start = now;
+			end = start + std::chrono::duration_cast<
+					std::chrono::steady_clock::duration>(measureTime);
+			cpuBefore = cpuTime();
+			lostBefore = source.getLostFrames();
+		} else if (measuring && now >= end) {
+			break;
+		}
+
+		ockl::SpectrumType* spectrum = outQueue.pop_front();
+		if (spectrum == nullptr) {
+			continue;
+		}
+		if (measuring) {
+			// the capture time is that of the first sample of the hop
+			latencies.record(std::chrono::system_clock::now()
+					- ockl::Queue<ockl::SpectrumType>::info(spectrum)
+							.captureTime - hopDuration);
+			count++;
+		}
+		ockl::bench::doNotOptimize(spectrum[binCount - 1]);
+		outQueue.release(spectrum);
+	}
+	double elapsed = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - start).count();
+	double cpu = cpuTime() - cpuBefore;
+	uint64_t lost = source.getLostFrames() - lostBefore;
+
+	source.shutdown();
+	fft.shutdown();
+	inQueue.shutdown();
+	outQueue.shutdown();
+
+	double spectraPerSecond = count / elapsed;
+	ockl::Histogram::Snapshot snapshot = latencies.snapshot();
+	std::cout << std::setw(7) << run.samplingRate << std::setw(9)
+			<< run.fftSize << std::setw(9) << run.hopSize
+			<< std::fixed << std::setprecision(1)
+			<< std::setw(11) << spectraPerSecond
+			<< std::setw(10) << spectraPerSecond * run.hopSize
+					/ run.samplingRate
+			<< std::setw(10) << snapshot.percentile(0.5)
+			<< std::setw(10) << snapshot.percentile(0.99)
+			<< std::setw(10) << snapshot.percentile(0.999)
+			<< std::setw(10) << snapshot.percentile(1.0)
+			<< std::setw(8) << 100 * cpu / elapsed
+			<< std::setw(10) << lost << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	std::vector<unsigned> rates{48000, 192000};
+	std::vector<unsigned> sizes{12, 16, 20};
+	unsigned overlap = 0;
+	Run run{0, 0, 0, 1, ockl::Planner::Estimate,
+		ockl::bench::Signal::Chirp, false, 3};
+
+	int option;
+	while ((option = getopt(argc, argv, "j:n:o:pP:r:s:t:")) != -1) {
+		try {
+			switch (option) {
+			case 'j':
+				run.workers = std::max(1, std::stoi(optarg));
+				break;
+			case 'n':
+				sizes = parseList(optarg);
+				break;
+			case 'o':
+				overlap = std::stoi(optarg);
+				if (overlap >= 100) {
+					throw std::out_of_range("overlap");
+				}
+				break;
+			case 'p':
+				run.paced = true;
+				break;
+			case 'P':
+				run.planner = ockl::parsePlanner(optarg);
+				break;
+			case 'r':
+				rates = parseList(optarg);
+				break;
+			case 's':
+				run.signal = ockl::bench::parseSignal(optarg);
+				break;
+			case 't':
+				run.seconds = std::stoi(optarg);
+				break;
+			default:
+				return -1;
+			}
+		} catch (...) {
+			std::cerr << "failed to parse option -" << (char) option << std::endl;
+			return -1;
+		}
+	}
+
+	ockl::Logger logger;
+
+	std::cout << (run.paced ? "paced" : "unpaced") << ", " << run.workers
+			<< " fft worker(s), latency in [us], cpu in [% of one core]"
+			<< std::endl
+			<< std::setw(7) << "rate" << std::setw(9) << "fft"
+			<< std::setw(9) << "hop" << std::setw(11) << "spectra/s"
+			<< std::setw(10) << "x rt" << std::setw(10) << "p50"
+			<< std::setw(10) << "p99" << std::setw(10) << "p999"
+			<< std::setw(10) << "max" << std::setw(8) << "cpu"
+			<< std::setw(10) << "lost" << std::endl;
+	for (unsigned rate : rates) {
+		for (unsigned log2 : sizes) {
+			run.samplingRate = rate;
+			run.fftSize = 1u << log2;
+			run.hopSize = std::max(1u, run.fftSize * (100 - overlap) / 100);
+			benchmark(run, logger);
+		}
+	}
+	return 0;
+}
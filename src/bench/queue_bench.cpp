@@ -0,0 +1,72 @@
+
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#include "bench.h"
+#include "locked_queue.h"
+#include "../utils/queue.h"
+
+/**
+ * Pushes elements through a queue from one thread to another, the way the
+ * alsa -> fft -> ui pipeline does: allocate, fill, push_back on one side,
+ * pop_front, read, release on the other side.
+ */
+template <typename QueueType>
+void transfer(QueueType& queue, uint64_t iterations)
+{
+	unsigned elementSize = queue.getElementSize();
+
+	std::thread consumer([&] {
+		uint64_t received = 0;
+		while (received < iterations) {
+			short* element = queue.pop_front();
+			if (element == nullptr) {
+				continue;
+			}
+			ockl::bench::doNotOptimize(element[elementSize - 1]);
+			queue.release(element);
+			received++;
+		}
+	});
+
+	uint64_t sent = 0;
+	while (sent < iterations) {
+		short* element = queue.allocate();
+		if (element == nullptr) {
+			continue;
+		}
+		element[0] = (short) sent;
+		element[elementSize - 1] = (short) sent;
+		queue.push_back(element);
+		sent++;
+	}
+
+	consumer.join();
+}
+
+template <template <typename> class QueueType>
+void benchmark(const std::string& name, unsigned elementSize,
+		unsigned elementCount)
+{
+	QueueType<short> queue(elementSize, elementCount,
+			std::chrono::milliseconds(100));
+	std::ostringstream oss;
+	oss << name << "/" << elementSize << "/" << elementCount;
+	ockl::bench::run(oss.str(), [&](uint64_t iterations) {
+		transfer(queue, iterations);
+	});
+}
+
+int main()
+{
+	ockl::bench::header();
+	for (unsigned elementSize : {64u, 1024u, 16384u}) {
+		for (unsigned elementCount : {2u, 10u, 64u}) {
+			benchmark<ockl::bench::LockedQueue>("locked", elementSize,
+					elementCount);
+			benchmark<ockl::Queue>("spsc", elementSize, elementCount);
+		}
+	}
+	return 0;
+}
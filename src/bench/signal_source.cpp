@@ -0,0 +1,165 @@
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <stdexcept>
+
+#include "signal_source.h"
+
+namespace ockl {
+namespace bench {
+
+Signal
+parseSignal(const std::string& name)
+{
+	if (name == "sine") {
+		return Signal::Sine;
+	} else if (name == "noise") {
+		return Signal::Noise;
+	} else if (name == "chirp") {
+		return Signal::Chirp;
+	}
+	throw std::runtime_error("unknown signal " + name);
+}
+
+SignalSource::
+SignalSource(Signal signal,
+		unsigned samplingRate,
+		bool paced,
+		Queue<SamplingType>& queue,
+		const Logger& logger)
+: samplingRate(samplingRate),
+  paced(paced),
+  queue(queue),
+  elementSize(queue.getElementSize()),
+  table(TableSize),
+  lostFrames(0),
+  logger(logger),
+  thread(nullptr),
+  doShutdown(false)
+{
+	double amplitude = FullScale / 2;
+	switch (signal) {
+	case Signal::Sine: {
+		// a whole number of periods in the table, so it loops seamlessly
+		double periods = std::max(1.0,
+				std::round(1000.0 * TableSize / samplingRate));
+		for (unsigned n = 0; n < TableSize; n++) {
+			table[n] = amplitude * sin(2 * M_PI * periods * n / TableSize);
+		}
+		break;
+	}
+	case Signal::Noise: {
+		std::mt19937 generator(1);
+		std::uniform_real_distribution<double> distribution(-amplitude,
+				amplitude);
+		for (unsigned n = 0; n < TableSize; n++) {
+			table[n] = distribution(generator);
+		}
+		break;
+	}
+	case Signal::Chirp: {
+		double start = 20;
+		double end = 0.45 * samplingRate;
+		double duration = (double) TableSize / samplingRate;
+		for (unsigned n = 0; n < TableSize; n++) {
+			double t = (double) n / samplingRate;
+			table[n] = amplitude * sin(2 * M_PI
+					* (start * t + (end - start) * t * t / (2 * duration)));
+		}
+		break;
+	}
+	}
+}
+
+SignalSource::
+~SignalSource()
+{
+	if (thread != nullptr) {
+		doShutdown = true;
+		thread->join();
+		delete thread;
+		thread = nullptr;
+	}
+}
+
+void
+SignalSource::
+start()
+{
+	thread = new std::thread(&SignalSource::threadFunction, this);
+	pthread_setname_np(thread->native_handle(), "signal");
+}
+
+void
+SignalSource::
+shutdown()
+{
+	doShutdown = true;
+}
+
+uint64_t
+SignalSource::
+getLostFrames() const
+{
+	return lostFrames;
+}
+
+void
+SignalSource::
+threadFunction()
+{
+	std::chrono::duration<double> elementTime((double) elementSize
+			/ samplingRate);
+	auto elementDuration = std::chrono::duration_cast<
+			std::chrono::steady_clock::duration>(elementTime);
+	auto start = std::chrono::steady_clock::now();
+	// element number, its last sample is captured at start + (k + 1) * time
+	uint64_t k = 0;
+	uint64_t position = 0;
+	uint64_t pendingLostFrames = 0;
+
+	while (!doShutdown) {
+		auto deadline = start + std::chrono::duration_cast<
+				std::chrono::steady_clock::duration>(elementTime * (k + 1));
+		if (paced) {
+			std::this_thread::sleep_until(deadline);
+		}
+
+		SamplingType* buffer = queue.allocate();
+		if (paced && !doShutdown) {
+			// The elements which came due while waiting for the queue are
+			// gone, as in an overrun, and so is this one without a buffer.
+			uint64_t missed = (std::chrono::steady_clock::now() - deadline)
+					/ elementDuration + (buffer == nullptr ? 1 : 0);
+			pendingLostFrames += missed * elementSize;
+			lostFrames += missed * elementSize;
+			position += missed * elementSize;
+			k += missed;
+		}
+		if (buffer == nullptr) {
+			continue;
+		}
+
+		for (unsigned i = 0; i < elementSize; ) {
+			unsigned offset = position % TableSize;
+			unsigned count = std::min(elementSize - i, TableSize - offset);
+			std::copy(table.begin() + offset, table.begin() + offset + count,
+					buffer + i);
+			i += count;
+			position += count;
+		}
+
+		ElementInfo& info = Queue<SamplingType>::info(buffer);
+		info.lostFrames = pendingLostFrames;
+		info.captureTime = std::chrono::system_clock::now()
+				- std::chrono::duration_cast<
+						std::chrono::system_clock::duration>(elementTime);
+		pendingLostFrames = 0;
+		queue.push_back(buffer);
+		k++;
+	}
+}
+
+} // namespace
+} // namespace
@@ -0,0 +1,78 @@
+#ifndef __SIGNAL_SOURCE__H
+#define __SIGNAL_SOURCE__H
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../utils/logger.h"
+#include "../utils/queue.h"
+#include "../defs.h"
+
+namespace ockl {
+namespace bench {
+
+enum class Signal {
+	Sine,
+	Noise,
+	Chirp
+};
+
+/**
+ * \throws std::runtime_error for an unknown name
+ */
+Signal parseSignal(const std::string& name);
+
+/**
+ * Synthetic stand-in for Alsa: fills one queue with a generated signal, a
+ * 1 kHz sine, white noise or a linear chirp from 20 Hz to 90% of Nyquist,
+ * each at half full scale.
+ *
+ * Paced, an element is pushed whenever its last sample would have been
+ * captured, like a device; if the queue is full the element is lost and
+ * the gap recorded in the next one, like an overrun. Unpaced, the source
+ * runs as fast as the consumer takes the elements.
+ *
+ * The signal is computed once into a table which is then copied out in a
+ * loop, so generating costs no more than the copy in Alsa.
+ */
+class SignalSource {
+public:
+	SignalSource(Signal signal,
+			unsigned samplingRate,
+			bool paced,
+			Queue<SamplingType>& queue,
+			const Logger& logger);
+	~SignalSource();
+
+	void start();
+	void shutdown();
+
+	/**
+	 * \return  the frames lost to a full queue so far
+	 */
+	uint64_t getLostFrames() const;
+
+private:
+	static const unsigned TableSize = 1u << 20;
+
+	void threadFunction();
+
+	unsigned samplingRate;
+	bool paced;
+	Queue<SamplingType>& queue;
+	unsigned elementSize;
+	std::vector<SamplingType> table;
+	std::atomic<uint64_t> lostFrames;
+
+	const Logger& logger;
+
+	std::thread* thread;
+	std::atomic<bool> doShutdown;
+};
+
+} // namespace
+} // namespace
+
+#endif
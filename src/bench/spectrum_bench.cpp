@@ -0,0 +1,41 @@
+
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+#include "bench.h"
+#include "../spectrum.h"
+
+/**
+ * Complex fft bins -> magnitude/power/dB for every kernel available on this
+ * cpu, for 2^10..2^20 bins.
+ */
+int main()
+{
+	ockl::bench::header();
+	for (unsigned log2 = 10; log2 <= 20; log2++) {
+		unsigned count = 1u << log2;
+		std::vector<ockl::SpectrumType> bins(2 * count);
+		for (ockl::SpectrumType& bin : bins) {
+			bin = (ockl::SpectrumType) (rand() % 65536 - 32768);
+		}
+		std::vector<ockl::SpectrumType> spectrum(count);
+
+		for (ockl::Scale scale : {ockl::Scale::Magnitude, ockl::Scale::Power,
+				ockl::Scale::Decibel}) {
+			for (auto& kernel : ockl::availableSpectrumKernels()) {
+				std::ostringstream oss;
+				oss << ockl::scaleName(scale) << "/" << kernel.name << "/"
+						<< count;
+				ockl::bench::run(oss.str(), [&](uint64_t iterations) {
+					for (uint64_t i = 0; i < iterations; i++) {
+						kernel.kernel(bins.data(), spectrum.data(), count,
+								scale, 1.0);
+						ockl::bench::doNotOptimize(spectrum[count - 1]);
+					}
+				}, count);
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,92 @@
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+
+#include "bench.h"
+#include "../fft.h"
+#include "../spectrum.h"
+#include "../tone_bank.h"
+#include "../window.h"
+
+/**
+ * Cost of following a few tones per hop: the sliding dft of ToneBank
+ * against what Fft does for every hop (window the history, r2c transform,
+ * convert the bins to dB). The throughput is in input samples, so the
+ * numbers compare directly to the sampling rate.
+ *
+ * usage: tone_bench [hop size (default 240, 5 ms at 48 kHz)]
+ */
+int main(int argc, char** argv)
+{
+	unsigned hopSize = argc > 1 ? atoi(argv[1]) : 240;
+	const unsigned SamplingRate = 48000;
+
+	ockl::bench::header();
+	for (unsigned log2 : {12, 16, 20}) {
+		unsigned size = 1u << log2;
+		std::vector<ockl::SamplingType> samples(size);
+		for (auto& sample : samples) {
+			sample = (ockl::SamplingType) (rand() % 2000 - 1000);
+		}
+
+		for (ockl::Window window : {ockl::Window::Rectangular,
+				ockl::Window::Hann}) {
+			std::vector<ockl::SpectrumType> history(size);
+			std::vector<double> coefficients = ockl::makeWindow(window, size);
+			std::vector<ockl::SpectrumType> table(coefficients.begin(),
+					coefficients.end());
+			ockl::SpectrumType* in = (ockl::SpectrumType*) FFTW(malloc)(
+					sizeof(ockl::SpectrumType) * size);
+			FFTW(complex)* out = (FFTW(complex)*) FFTW(malloc)(
+					sizeof(FFTW(complex)) * (size / 2 + 1));
+			FFTW(plan) plan = FFTW(plan_dft_r2c_1d)(size, in, out,
+					FFTW_ESTIMATE | FFTW_DESTROY_INPUT);
+			std::vector<ockl::SpectrumType> spectrum(size / 2 + 1);
+
+			std::ostringstream oss;
+			oss << "fft/" << ockl::windowName(window) << "/" << size;
+			ockl::bench::run(oss.str(), [&](uint64_t iterations) {
+				for (uint64_t i = 0; i < iterations; i++) {
+					for (unsigned n = 0; n < size; n++) {
+						in[n] = history[n] * table[n];
+					}
+					FFTW(execute)(plan);
+					ockl::computeSpectrum((const ockl::SpectrumType*) out,
+							spectrum.data(), size / 2 + 1, ockl::Scale::Decibel,
+							size);
+					ockl::bench::doNotOptimize(spectrum[0]);
+				}
+			}, hopSize);
+
+			FFTW(destroy_plan)(plan);
+			FFTW(free)(in);
+			FFTW(free)(out);
+
+			for (unsigned tones : {1, 4, 16}) {
+				std::vector<double> frequencies;
+				for (unsigned tone = 0; tone < tones; tone++) {
+					frequencies.push_back(1000.0 * (tone + 1) + 0.5);
+				}
+				ockl::SlidingDft dft(frequencies, SamplingRate, size, window);
+				std::vector<ockl::SpectrumType> levels(tones);
+				unsigned offset = 0;
+
+				std::ostringstream oss;
+				oss << "sliding-dft/" << ockl::windowName(window) << "/"
+						<< size << "/" << tones << " tones";
+				ockl::bench::run(oss.str(), [&](uint64_t iterations) {
+					for (uint64_t i = 0; i < iterations; i++) {
+						if (offset + hopSize > size) {
+							offset = 0;
+						}
+						dft.append(samples.data() + offset, hopSize);
+						offset += hopSize;
+						dft.levels(levels.data(), ockl::Scale::Decibel);
+						ockl::bench::doNotOptimize(levels[0]);
+					}
+				}, hopSize);
+			}
+		}
+	}
+	return 0;
+}
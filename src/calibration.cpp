@@ -0,0 +1,105 @@
+
+#include <stdexcept>
+
+#include "calibration.h"
+#include "defs.h"
+
+namespace ockl {
+
+void
+parseUnit(const std::string& value, Calibration& calibration)
+{
+	if (value == "sample") {
+		calibration.unit = Unit::Sample;
+	} else if (value == "fs") {
+		calibration.unit = Unit::FullScale;
+	} else if (value.compare(0, 2, "v:") == 0) {
+		calibration.unit = Unit::Volt;
+		calibration.volts = std::stod(value.substr(2));
+		if (calibration.volts <= 0) {
+			throw std::runtime_error("full scale voltage must be positive");
+		}
+	} else {
+		throw std::runtime_error("unknown unit " + value);
+	}
+}
+
+std::string
+unitLabel(const Calibration& calibration, Scale scale)
+{
+	std::string unit;
+	switch (calibration.unit) {
+	case Unit::Sample:
+		break;
+	case Unit::FullScale:
+		unit = "FS";
+		break;
+	case Unit::Volt:
+		unit = "V";
+		break;
+	}
+
+	switch (scale) {
+	case Scale::Magnitude:
+		return calibration.density ? unit + "/√Hz" : unit;
+	case Scale::Power:
+		if (!unit.empty()) {
+			unit += "²";
+		}
+		return calibration.density ? unit + "/Hz" : unit;
+	case Scale::Decibel:
+		// a density in dBV is per square root Hz, the power is per Hz
+		if (calibration.density) {
+			return calibration.unit == Unit::Volt ? "dBV/√Hz"
+					: "dB" + unit + "/Hz";
+		}
+		return "dB" + unit;
+	}
+	return unit;
+}
+
+bool
+isCalibrated(const Calibration& calibration)
+{
+	return calibration.unit != Unit::Sample || calibration.density;
+}
+
+std::vector<double>
+calibrationFactors(const Calibration& calibration,
+		Window window, unsigned fftSize, unsigned samplingRate)
+{
+	unsigned binCount = fftSize / 2 + 1;
+	if (!isCalibrated(calibration)) {
+		return std::vector<double>(binCount, 1.0);
+	}
+
+	// A sine of amplitude A has the power (A / 2)^2 in its bin, folded
+	// A^2 / 2, its mean square.
+	double factor = 2;
+	switch (calibration.unit) {
+	case Unit::Sample:
+		break;
+	case Unit::FullScale:
+		// the full scale sine, (FullScale^2 / 2), is 1
+		factor *= 2 / (FullScale * FullScale);
+		break;
+	case Unit::Volt:
+		factor *= (calibration.volts / FullScale)
+				* (calibration.volts / FullScale);
+		break;
+	}
+	if (calibration.density) {
+		double resolution = (double) samplingRate / fftSize;
+		factor /= noiseBandwidth(window, fftSize) * resolution;
+	}
+
+	std::vector<double> factors(binCount, factor);
+	// DC and nyquist have no negative counterpart
+	factors.front() /= 2;
+	if (fftSize % 2 == 0) {
+		factors.back() /= 2;
+	}
+	return factors;
+}
+
+} // namespace
@@ -0,0 +1,72 @@
+
+#ifndef __CALIBRATION__H
+#define __CALIBRATION__H
+
+#include <string>
+#include <vector>
+
+#include "spectrum.h"
+#include "window.h"
+
+namespace ockl {
+
+enum class Unit {
+	/**
+	 * sample values, uncalibrated
+	 */
+	Sample,
+	/**
+	 * relative to a full scale sine, 0 dBFS
+	 */
+	FullScale,
+	/**
+	 * volts rms, 0 dBV
+	 */
+	Volt
+};
+
+struct Calibration {
+	Unit unit;
+	/**
+	 * peak voltage of a full scale sample, for Unit::Volt
+	 */
+	double volts;
+	/**
+	 * power spectral density (per Hz) instead of the power of a sine per
+	 * bin, averaged over the frames this is Welch's method
+	 */
+	bool density;
+};
+
+/**
+ * Parses "sample", "fs" or "v:<peak volts at full scale>" into the unit
+ * fields of `calibration`.
+ * \throws std::runtime_error for an unknown unit
+ */
+void parseUnit(const std::string& value, Calibration& calibration);
+
+/**
+ * \return  e.g. "dBFS/Hz" for a density in full scale units in decibel
+ */
+std::string unitLabel(const Calibration& calibration, Scale scale);
+
+/**
+ * \return  whether calibrationFactors() would be anything but ones
+ */
+bool isCalibrated(const Calibration& calibration);
+
+/**
+ * Factors from the power spectra of a real input Fft (fftSize / 2 + 1 bins,
+ * normalized by the coherent gain of the window, see Scale::Power) to the
+ * calibrated power of every bin. The negative frequencies are folded onto
+ * the positive ones (twice the power, except for DC and nyquist). A density
+ * divides by the equivalent noise bandwidth of the window in Hz, which
+ * turns the coherent gain normalization into the window power
+ * normalization of a power spectral density.
+ */
+std::vector<double> calibrationFactors(const Calibration& calibration,
+		Window window, unsigned fftSize, unsigned samplingRate);
+
+} // namespace
+
+#endif
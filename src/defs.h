@@ -2,9 +2,31 @@
 #ifndef __DEFS__H
 #define __DEFS__H
 
+#include <chrono>
+
 namespace ockl {
 
-typedef short SamplingType;
+/**
+ * Samples of every capture format are converted to float in units of a 16
+ * bit sample, so the levels do not depend on the format. Wider formats keep
+ * their extra resolution in the fraction.
+ */
+typedef float SamplingType;
+/**
+ * Type of the fft buffers and of the spectra passed between the stages:
+ * float with -DSINGLE_PRECISION=ON, which halves the memory traffic of the
+ * large transforms (the samples have at most 24 bits anyway), double
+ * otherwise.
+ */
+#ifdef SINGLE_PRECISION
+typedef float SpectrumType;
+#else
+typedef double SpectrumType;
+#endif
+/**
+ * magnitude of a full scale sample
+ */
+const double FullScale = 32768.0;
 const std::chrono::milliseconds Timeout = std::chrono::milliseconds(100);
 
 } // namespace
@@ -1,22 +1,115 @@
 
 #include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
 
 #include "fft.h"
 
 namespace ockl {
 
+Planner
+parsePlanner(const std::string& name)
+{
+	if (name == "estimate") {
+		return Planner::Estimate;
+	} else if (name == "measure") {
+		return Planner::Measure;
+	} else if (name == "patient") {
+		return Planner::Patient;
+	}
+	throw std::runtime_error("unknown planner " + name);
+}
+
+unsigned
+plannerFlags(Planner planner)
+{
+	unsigned flags = FFTW_DESTROY_INPUT;
+	switch (planner) {
+	case Planner::Estimate:
+		flags |= FFTW_ESTIMATE;
+		break;
+	case Planner::Measure:
+		flags |= FFTW_MEASURE;
+		break;
+	case Planner::Patient:
+		flags |= FFTW_PATIENT;
+		break;
+	}
+	return flags;
+}
+
+void
+importWisdom(const std::string& wisdomFile, const Logger& logger)
+{
+	if (!wisdomFile.empty()) {
+		if (::FFTW(import_wisdom_from_filename)(wisdomFile.c_str())) {
+			LOGGER_DEBUG("loaded fftw wisdom from " << wisdomFile);
+		}
+	}
+}
+
+void
+exportWisdom(const std::string& wisdomFile, Planner planner,
+		const Logger& logger)
+{
+	if (!wisdomFile.empty() && planner != Planner::Estimate) {
+		if (!::FFTW(export_wisdom_to_filename)(wisdomFile.c_str())) {
+			LOGGER_WARNING("failed to save fftw wisdom to " << wisdomFile);
+		}
+	}
+}
+
 Fft::
-Fft(unsigned fftSize,
+Fft(const FftSettings& settings,
 		Queue<SamplingType>& inQueue,
-		Queue<double>& outQueue,
+		Queue<SpectrumType>& outQueue,
+		const Logger& logger)
+: Fft(settings, &inQueue, nullptr, outQueue, logger)
+{
+}
+
+Fft::
+Fft(const FftSettings& settings,
+		Queue<double>& complexQueue,
+		Queue<SpectrumType>& outQueue,
 		const Logger& logger)
-: fftSize(fftSize),
+: Fft(settings, nullptr, &complexQueue, outQueue, logger)
+{
+}
+
+Fft::
+Fft(const FftSettings& settings,
+		Queue<SamplingType>* inQueue,
+		Queue<double>* complexQueue,
+		Queue<SpectrumType>& outQueue,
+		const Logger& logger)
+: fftSize(settings.fftSize),
+  hopSize(settings.hopSize),
+  window(settings.window),
+  scale(settings.scale),
+  planner(settings.planner),
+  wisdomFile(settings.wisdomFile),
+  workerCount(settings.workers),
+  lossless(settings.lossless),
+  threadSettings(settings.threads),
+  nextWorker(0),
+  windowGain(0),
+  complexInput(complexQueue != nullptr),
+  values(complexInput ? 2 * fftSize : fftSize),
+  binCount(complexInput ? fftSize : fftSize / 2 + 1),
+  history(values),
+  lostFrames(0),
   inQueue(inQueue),
+  complexQueue(complexQueue),
   outQueue(outQueue),
   logger(logger),
   thread(nullptr),
+  reorderThread(nullptr),
   doShutdown(false),
-  plan(nullptr)
+  plan(nullptr),
+  in(nullptr),
+  out(nullptr)
 {
 }
 
@@ -27,15 +120,29 @@ Fft::
 		return;
 	}
 
+	doShutdown = true;
 	if (thread != nullptr) {
-		doShutdown = true;
 		thread->join();
 		delete thread;
 		thread = nullptr;
 	}
+	for (auto& worker : workers) {
+		if (worker.thread != nullptr) {
+			worker.thread->join();
+			delete worker.thread;
+		}
+		::FFTW(free)(worker.out);
+	}
+	if (reorderThread != nullptr) {
+		reorderThread->join();
+		delete reorderThread;
+		reorderThread = nullptr;
+	}
 
-	::rfftw_destroy_plan(plan);
+	::FFTW(destroy_plan)(plan);
 	plan = nullptr;
+	::FFTW(free)(in);
+	::FFTW(free)(out);
 }
 
 void
@@ -50,7 +157,83 @@ init()
 		LOGGER_WARNING("period size not a power of 2 - fft will be slow");
 	}
 
-	plan = ::rfftw_create_plan(fftSize, FFTW_FORWARD, FFTW_ESTIMATE);
+	if (hopSize == 0 || hopSize > fftSize) {
+		throw std::runtime_error("hop size must be in the range [1, fft size]");
+	}
+
+	if (workerCount == 0) {
+		throw std::runtime_error("at least one fft worker is needed");
+	}
+
+	// Computed once here, the transform only multiplies. The spectrum is
+	// normalized by the sum of the window (its coherent gain), which is
+	// fftSize for the rectangular window.
+	std::vector<double> table = makeWindow(window, fftSize);
+	windowTable.assign(table.begin(), table.end());
+	windowGain = 0;
+	for (double value : table) {
+		windowGain += value;
+	}
+
+	LOGGER_INFO("fft window: " << windowName(window) << ", hop size: "
+			<< hopSize << " [frames] (" << 100 - hopSize * 100 / fftSize
+			<< "% overlap)");
+
+	createPlan();
+
+	// Two elements per worker queue: one being worked on, one waiting.
+	if (workerCount > 1) {
+		LOGGER_INFO("fft workers: " << workerCount);
+		for (unsigned i = 0; i < workerCount; i++) {
+			Worker worker;
+			worker.frames.reset(new Queue<SpectrumType>(values, 2, Timeout));
+			worker.spectra.reset(new Queue<SpectrumType>(binCount, 2, Timeout));
+			worker.out = (::FFTW(complex)*) ::FFTW(malloc)(
+					sizeof(::FFTW(complex)) * binCount);
+			worker.thread = nullptr;
+			workers.push_back(std::move(worker));
+			if (workers.back().out == nullptr) {
+				throw std::runtime_error("failed to allocate fft buffers");
+			}
+		}
+	}
+}
+
+void
+Fft::
+createPlan()
+{
+	// fftw_malloc returns buffers aligned for the SIMD code paths of fftw,
+	// the plan is only valid for buffers with the same alignment.
+	in = (SpectrumType*) ::FFTW(malloc)(sizeof(SpectrumType) * values);
+	out = (::FFTW(complex)*) ::FFTW(malloc)(
+			sizeof(::FFTW(complex)) * binCount);
+	if (in == nullptr || out == nullptr) {
+		::FFTW(free)(in);
+		::FFTW(free)(out);
+		throw std::runtime_error("failed to allocate fft buffers");
+	}
+
+	importWisdom(wisdomFile, logger);
+	unsigned flags = plannerFlags(planner);
+
+	auto start = std::chrono::steady_clock::now();
+	plan = complexInput
+			? ::FFTW(plan_dft_1d)(fftSize, (::FFTW(complex)*) in, out,
+					FFTW_FORWARD, flags)
+			: ::FFTW(plan_dft_r2c_1d)(fftSize, in, out, flags);
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start);
+	if (plan == nullptr) {
+		::FFTW(free)(in);
+		::FFTW(free)(out);
+		in = nullptr;
+		out = nullptr;
+		throw std::runtime_error("failed to create fft plan");
+	}
+	LOGGER_INFO("fft planning took " << duration.count() << " [ms]");
+
+	exportWisdom(wisdomFile, planner, logger);
 }
 
 void
@@ -63,6 +246,20 @@ start()
 
 	thread = new std::thread(&Fft::threadFunction, this);
 	pthread_setname_np(thread->native_handle(), "fft");
+	configureThread(*thread, threadSettings);
+
+	for (unsigned i = 0; i < workers.size(); i++) {
+		workers[i].thread = new std::thread(&Fft::workerFunction, this, i);
+		std::string name = "fft-worker-" + std::to_string(i);
+		pthread_setname_np(workers[i].thread->native_handle(), name.c_str());
+		configureThread(*workers[i].thread, threadSettings);
+	}
+	if (!workers.empty()) {
+		reorderThread = new std::thread(&Fft::reorderFunction, this);
+		pthread_setname_np(reorderThread->native_handle(), "fft-reorder");
+		configureThread(*reorderThread, threadSettings);
+	}
+	LOGGER_INFO("fft threads: " << describe(threadSettings));
 }
 
 void
@@ -72,43 +269,272 @@ shutdown()
 	doShutdown = true;
 }
 
+const Histogram&
+Fft::
+computeTimes() const
+{
+	return computeTimeHistogram;
+}
+
 void
 Fft::
 threadFunction()
 {
-	fftw_real* in = new fftw_real[fftSize];
-	fftw_real* out = new fftw_real[fftSize];
+	if (complexInput) {
+		consume(*complexQueue);
+	} else {
+		consume(*inQueue);
+	}
+}
+
+/**
+ * Complex samples are just pairs of values here, the history and the hop
+ * are counted in values.
+ */
+template <typename T>
+void
+Fft::
+consume(Queue<T>& queue)
+{
+	unsigned periodSize = queue.getElementSize();
+	unsigned hop = complexInput ? 2 * hopSize : hopSize;
+	unsigned pending = 0;
 
 	while (!doShutdown) {
-		double* spectrum = outQueue.allocate();
-		if (spectrum == nullptr) {
+		T* inBuffer = queue.pop_front();
+		if (inBuffer == nullptr) {
 			continue;
 		}
 
-		SamplingType* inBuffer = inQueue.pop_front();
-		if (inBuffer == nullptr) {
-			outQueue.release(spectrum);
-			continue;
+		captureTime = Queue<T>::info(inBuffer).captureTime;
+		uint64_t lost = Queue<T>::info(inBuffer).lostFrames;
+		unsigned valid = periodSize - Queue<T>::info(inBuffer).padding;
+		if (lost > 0) {
+			history.clear();
+			pending = 0;
+			lostFrames += lost;
 		}
 
-		std::copy(inBuffer, inBuffer + fftSize, in);
-		inQueue.release(inBuffer);
+		// One element of the input queue might contain several hops (or
+		// only part of one), every completed hop produces a spectrum. The
+		// padding of the last element is not signal, a hop it would have to
+		// complete is dropped.
+		unsigned offset = 0;
+		while (offset < valid && !doShutdown) {
+			unsigned count = std::min(valid - offset, hop - pending);
+			history.append(inBuffer + offset, count);
+			offset += count;
+			pending += count;
+			if (pending == hop) {
+				pending = 0;
+				if (history.full()) {
+					dispatch();
+				}
+			}
+		}
 
-		rfftw_one(plan, in, out);
+		bool endOfStream = Queue<T>::info(inBuffer).endOfStream;
+		queue.release(inBuffer);
+		if (endOfStream) {
+			finish();
+		}
+	}
+}
 
-		spectrum[0] = sqrt(out[0] * out[0]) / fftSize;
-		for (unsigned i = 0; i < (fftSize + 1) / 2; i++) {
-			spectrum[i] = sqrt(out[i] * out[i] + out[fftSize - i] * out[fftSize - i]) / fftSize;
+/**
+ * Waits for a free element if asked to, until shutdown.
+ */
+SpectrumType*
+Fft::
+allocate(Queue<SpectrumType>& queue, bool wait)
+{
+	SpectrumType* element = queue.allocate();
+	while (element == nullptr && wait && !doShutdown) {
+		element = queue.allocate();
+	}
+	return element;
+}
+
+/**
+ * Passes the end of stream marker on, in order with the spectra.
+ */
+void
+Fft::
+finish()
+{
+	Queue<SpectrumType>& queue = workers.empty()
+			? outQueue : *workers[nextWorker].frames;
+	SpectrumType* element = allocate(queue, true);
+	if (element == nullptr) {
+		return;
+	}
+	tag(element);
+	Queue<SpectrumType>::info(element).endOfStream = true;
+	queue.push_back(element);
+	if (!workers.empty()) {
+		nextWorker = (nextWorker + 1) % workers.size();
+	}
+}
+
+void
+Fft::
+dispatch()
+{
+	if (workers.empty()) {
+		transform();
+		return;
+	}
+
+	// If the worker is busy the frame is dropped, but the next frame still
+	// goes to the same worker, so that the round robin order is kept.
+	Worker& worker = workers[nextWorker];
+	SpectrumType* frame = allocate(*worker.frames, lossless);
+	if (frame == nullptr) {
+		return;
+	}
+	applyWindow(frame);
+	tag(frame);
+	worker.frames->push_back(frame);
+	nextWorker = (nextWorker + 1) % workers.size();
+}
+
+/**
+ * Hands the gap since the last output and the capture time on to the next
+ * output element.
+ */
+void
+Fft::
+tag(SpectrumType* element)
+{
+	ElementInfo& info = Queue<SpectrumType>::info(element);
+	info.lostFrames = lostFrames;
+	info.captureTime = captureTime;
+	lostFrames = 0;
+}
+
+void
+Fft::
+applyWindow(SpectrumType* frame)
+{
+	const SpectrumType* samples = history.latest();
+	if (complexInput) {
+		for (unsigned i = 0; i < fftSize; i++) {
+			frame[2 * i] = samples[2 * i] * windowTable[i];
+			frame[2 * i + 1] = samples[2 * i + 1] * windowTable[i];
 		}
-		if (fftSize % 2 == 0) {
-			spectrum[fftSize / 2] = sqrt(out[fftSize / 2] * out[fftSize / 2]) / fftSize;
+	} else {
+		for (unsigned i = 0; i < fftSize; i++) {
+			frame[i] = samples[i] * windowTable[i];
 		}
+	}
+}
 
-		outQueue.push_back(spectrum);
+/**
+ * The spectrum of a complex signal starts with the negative frequencies,
+ * which fftw puts into the second half of the bins.
+ */
+void
+Fft::
+toSpectrum(const ::FFTW(complex)* bins, SpectrumType* spectrum)
+{
+	if (complexInput) {
+		unsigned half = fftSize / 2;
+		computeSpectrum((const SpectrumType*) (bins + half), spectrum,
+				fftSize - half, scale, windowGain);
+		computeSpectrum((const SpectrumType*) bins, spectrum + fftSize - half,
+				half, scale, windowGain);
+	} else {
+		computeSpectrum((const SpectrumType*) bins, spectrum, binCount, scale,
+				windowGain);
 	}
+}
 
-	delete[] in;
-	delete[] out;
+void
+Fft::
+transform()
+{
+	SpectrumType* spectrum = allocate(outQueue, lossless);
+	if (spectrum == nullptr) {
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	applyWindow(in);
+
+	::FFTW(execute)(plan);
+
+	toSpectrum(out, spectrum);
+	computeTimeHistogram.record(std::chrono::steady_clock::now() - start);
+	tag(spectrum);
+
+	outQueue.push_back(spectrum);
+}
+
+void
+Fft::
+workerFunction(unsigned index)
+{
+	Worker& worker = workers[index];
+
+	while (!doShutdown) {
+		SpectrumType* frame = worker.frames->pop_front();
+		if (frame == nullptr) {
+			continue;
+		}
+
+		// Never drop a frame here, the reorder thread expects the next
+		// spectrum from this worker.
+		SpectrumType* spectrum = allocate(*worker.spectra, true);
+		if (spectrum == nullptr) {
+			worker.frames->release(frame);
+			break;
+		}
+
+		// fftw_execute_dft_r2c is thread safe, the frame has the same (or
+		// better) alignment as the buffer the plan was made for.
+		bool endOfStream = Queue<SpectrumType>::info(frame).endOfStream;
+		auto start = std::chrono::steady_clock::now();
+		if (!endOfStream && complexInput) {
+			::FFTW(execute_dft)(plan, (::FFTW(complex)*) frame, worker.out);
+		} else if (!endOfStream) {
+			::FFTW(execute_dft_r2c)(plan, frame, worker.out);
+		}
+		Queue<SpectrumType>::info(spectrum) = Queue<SpectrumType>::info(frame);
+		worker.frames->release(frame);
+
+		if (!endOfStream) {
+			toSpectrum(worker.out, spectrum);
+			computeTimeHistogram.record(
+					std::chrono::steady_clock::now() - start);
+		}
+
+		worker.spectra->push_back(spectrum);
+	}
+}
+
+void
+Fft::
+reorderFunction()
+{
+	unsigned next = 0;
+
+	while (!doShutdown) {
+		SpectrumType* spectrum = workers[next].spectra->pop_front();
+		if (spectrum == nullptr) {
+			continue;
+		}
+
+		SpectrumType* element = allocate(outQueue, lossless);
+		if (element != nullptr) {
+			std::copy(spectrum, spectrum + binCount, element);
+			Queue<SpectrumType>::info(element)
+					= Queue<SpectrumType>::info(spectrum);
+			outQueue.push_back(element);
+		}
+		workers[next].spectra->release(spectrum);
+
+		next = (next + 1) % workers.size();
+	}
 }
 
 } // namespace
@@ -2,23 +2,130 @@
 #ifndef __FFT__H
 #define __FFT__H
 
+#include <chrono>
 #include <functional>
 #include <thread>
 #include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
 
-#include <rfftw.h>
+#include <fftw3.h>
 
+#include "utils/histogram.h"
+#include "utils/history.h"
 #include "utils/logger.h"
 #include "utils/queue.h"
+#include "utils/realtime.h"
+#include "spectrum.h"
+#include "window.h"
 #include "defs.h"
 
+/**
+ * fftw has one set of functions and types per precision, fftwf_ for float.
+ */
+#ifdef SINGLE_PRECISION
+#define FFTW(name) fftwf_##name
+#else
+#define FFTW(name) fftw_##name
+#endif
+
 namespace ockl {
 
+/**
+ * How much time fftw may spend on finding the fastest plan. Measure and
+ * patient actually run and time candidate algorithms, which takes seconds
+ * for large sizes, but the result is kept as wisdom on disk.
+ */
+enum class Planner {
+	Estimate,
+	Measure,
+	Patient
+};
+
+/**
+ * \throws std::runtime_error for an unknown name
+ */
+Planner parsePlanner(const std::string& name);
+
+/**
+ * \return  the fftw flags of `planner`, including FFTW_DESTROY_INPUT
+ */
+unsigned plannerFlags(Planner planner);
+
+/**
+ * Loads fftw wisdom from `wisdomFile` before planning, if it exists. Does
+ * nothing for an empty file name.
+ */
+void importWisdom(const std::string& wisdomFile, const Logger& logger);
+
+/**
+ * Saves the fftw wisdom after planning. Does nothing for an empty file name
+ * or Planner::Estimate, which does not produce any wisdom worth keeping.
+ */
+void exportWisdom(const std::string& wisdomFile, Planner planner,
+		const Logger& logger);
+
+struct FftSettings {
+	unsigned fftSize;
+	unsigned hopSize;
+	Window window;
+	Scale scale;
+	Planner planner;
+	/**
+	 * fftw wisdom is loaded from and saved to this file, an empty string
+	 * disables the cache
+	 */
+	std::string wisdomFile;
+	/**
+	 * number of threads running transforms, see Fft
+	 */
+	unsigned workers;
+	/**
+	 * wait for the output queue instead of dropping spectra when it is
+	 * full, for offline analysis where the input can wait as well
+	 */
+	bool lossless;
+	/**
+	 * scheduling of the fft thread and its workers
+	 */
+	ThreadSettings threads;
+};
+
+/**
+ * Short time fourier transform: the samples popped from the input queue are
+ * collected in a history of fftSize samples, and every hopSize samples the
+ * windowed history is transformed. A hop size smaller than the fft size
+ * gives overlapping frames, e.g. fftSize / 4 for 75% overlap. The elements
+ * of the input queue do not need to be related to either size.
+ *
+ * With a single worker the fft thread does everything itself. With more
+ * workers the fft thread only assembles the windowed frames and hands them
+ * round robin to the worker threads, and a reorder thread collects the
+ * spectra from the workers in the same round robin order. Thus the output
+ * queue sees the spectra in the order of the frames, no matter which worker
+ * finished first.
+ *
+ * A gap in the input (lost frames, see ElementInfo) restarts the history,
+ * so no frame spans the gap, and the gap is reported in the ElementInfo of
+ * the next spectrum. The end of a finite input stream is passed on as an
+ * (empty) output element marked endOfStream.
+ */
 class Fft {
 public:
-	Fft(unsigned fftSize,
+	Fft(const FftSettings& settings,
 			Queue<SamplingType>& inQueue,
-			Queue<double>& outQueue,
+			Queue<SpectrumType>& outQueue,
+			const Logger& logger);
+	/**
+	 * Complex input, e.g. from Zoom: the elements hold interleaved real
+	 * and imaginary parts, and the hop size counts complex samples. The
+	 * spectra have fftSize bins from -fs/2 to fs/2 (exclusive) instead of
+	 * fftSize / 2 + 1 bins from 0 to fs/2.
+	 */
+	Fft(const FftSettings& settings,
+			Queue<double>& complexQueue,
+			Queue<SpectrumType>& outQueue,
 			const Logger& logger);
 	~Fft();
 
@@ -26,19 +133,83 @@ public:
 	void start();
 	void shutdown();
 
+	/**
+	 * Distribution of the time one spectrum takes: window, transform and
+	 * conversion of the bins, without the windowing with several workers.
+	 */
+	const Histogram& computeTimes() const;
+
 private:
+	Fft(const FftSettings& settings,
+			Queue<SamplingType>* inQueue,
+			Queue<double>* complexQueue,
+			Queue<SpectrumType>& outQueue,
+			const Logger& logger);
+
+	void createPlan();
 	void threadFunction();
+	template <typename T>
+	void consume(Queue<T>& queue);
+	void transform();
+	void dispatch();
+	void finish();
+	SpectrumType* allocate(Queue<SpectrumType>& queue, bool wait);
+	void applyWindow(SpectrumType* frame);
+	void toSpectrum(const ::FFTW(complex)* bins, SpectrumType* spectrum);
+	void tag(SpectrumType* element);
+	void workerFunction(unsigned index);
+	void reorderFunction();
+
+	struct Worker {
+		std::unique_ptr<Queue<SpectrumType>> frames;
+		std::unique_ptr<Queue<SpectrumType>> spectra;
+		::FFTW(complex)* out;
+		std::thread* thread;
+	};
 
 	unsigned long fftSize;
+	unsigned hopSize;
+	Window window;
+	Scale scale;
+	Planner planner;
+	std::string wisdomFile;
+	unsigned workerCount;
+	bool lossless;
+	ThreadSettings threadSettings;
+	std::vector<Worker> workers;
+	unsigned nextWorker;
+	std::vector<SpectrumType> windowTable;
+	double windowGain;
+	bool complexInput;
+	/**
+	 * values per frame: fftSize, or 2 * fftSize for complex input
+	 */
+	unsigned values;
+	unsigned binCount;
+	History<SpectrumType> history;
+	/**
+	 * frames lost since the last spectrum
+	 */
+	uint64_t lostFrames;
+	/**
+	 * capture time of the latest input element
+	 */
+	std::chrono::system_clock::time_point captureTime;
 
-	Queue<SamplingType>& inQueue;
-	Queue<double>& outQueue;
+	Queue<SamplingType>* inQueue;
+	Queue<double>* complexQueue;
+	Queue<SpectrumType>& outQueue;
 
 	const Logger& logger;
 
+	Histogram computeTimeHistogram;
+
 	std::thread* thread;
+	std::thread* reorderThread;
 	std::atomic<bool> doShutdown;
-	::rfftw_plan plan;
+	::FFTW(plan) plan;
+	SpectrumType* in;
+	::FFTW(complex)* out;
 };
 
 } // namespace
@@ -0,0 +1,260 @@
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "file_sink.h"
+
+namespace ockl {
+
+namespace {
+
+const std::string SocketPrefix = "unix:";
+
+void
+throwError(const std::string& what, const std::string& fileName)
+{
+	std::ostringstream oss;
+	oss << "failed to " << what << " " << fileName << ": " << strerror(errno);
+	throw std::runtime_error(oss.str());
+}
+
+} // namespace
+
+FileSink::
+FileSink(const std::string& fileName,
+		const std::vector<Queue<SpectrumType>*>& queues,
+		bool tones,
+		unsigned samplingRate,
+		const FrequencyAxis& axis,
+		Scale scale,
+		const PeakSettings& peakSettings,
+		Histogram& writeTimes,
+		const Logger& logger)
+: fileName(fileName),
+  queues(queues),
+  binCount(queues.front()->getElementSize()),
+  magic(tones ? FrameHeader::ToneMagic
+		  : axis.logarithmic ? FrameHeader::LogMagic : FrameHeader::Magic),
+  samplingRate(samplingRate),
+  axis(axis),
+  fd(-1),
+  headers(MaxBatch),
+  bins(MaxBatch * binCount),
+  peakFinder(peakSettings.count > 0 && !tones ? new PeakFinder(peakSettings,
+		  binCount, axis, scale) : nullptr),
+  peakHeaders(peakFinder ? MaxBatch : 0),
+  peakStride(2 + 3 * peakSettings.count),
+  peakValues(peakFinder ? MaxBatch * peakStride : 0),
+  iov(4 * MaxBatch),
+  iovCount(0),
+  batch(0),
+  writeTimes(writeTimes),
+  logger(logger)
+{
+}
+
+FileSink::
+~FileSink()
+{
+	if (fd >= 0) {
+		::close(fd);
+	}
+}
+
+void
+FileSink::
+open()
+{
+	if (fileName.compare(0, SocketPrefix.size(), SocketPrefix) != 0) {
+		fd = ::open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0) {
+			throwError("open", fileName);
+		}
+		return;
+	}
+
+	std::string path = fileName.substr(SocketPrefix.size());
+	::sockaddr_un address;
+	if (path.size() >= sizeof(address.sun_path)) {
+		throw std::runtime_error("socket path too long: " + path);
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+	fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		throwError("create socket for", path);
+	}
+	if (::connect(fd, (const ::sockaddr*) &address, sizeof(address)) < 0) {
+		throwError("connect to", path);
+	}
+	LOGGER_INFO("connected to " << path);
+}
+
+uint64_t
+FileSink::
+run(const std::atomic<bool>& interrupted)
+{
+	open();
+
+	// The channels are in lock step. Spectra are collected as long as they
+	// are ready, and written once nothing is ready or the batch is full.
+	std::vector<SpectrumType*> spectra(queues.size(), nullptr);
+	auto releaseAll = [&] {
+		for (unsigned channel = 0; channel < queues.size(); channel++) {
+			if (spectra[channel] != nullptr) {
+				queues[channel]->release(spectra[channel]);
+			}
+		}
+	};
+	uint64_t written = 0;
+	bool endOfStream = false;
+	try {
+		while (!endOfStream && !interrupted) {
+			bool ready = true;
+			for (unsigned channel = 0; channel < queues.size(); channel++) {
+				if (spectra[channel] == nullptr) {
+					spectra[channel] = queues[channel]->pop_front(batch > 0);
+				}
+				ready &= spectra[channel] != nullptr;
+			}
+			if (!ready) {
+				flush();
+				continue;
+			}
+
+			for (unsigned channel = 0; channel < queues.size(); channel++) {
+				endOfStream |= Queue<SpectrumType>::info(
+						spectra[channel]).endOfStream;
+				if (!endOfStream) {
+					if (batch == MaxBatch) {
+						flush();
+					}
+					add(channel, spectra[channel]);
+					written++;
+				}
+				queues[channel]->release(spectra[channel]);
+				spectra[channel] = nullptr;
+			}
+		}
+		flush();
+	} catch (...) {
+		releaseAll();
+		throw;
+	}
+	releaseAll();
+
+	LOGGER_INFO("wrote " << written << " spectra to " << fileName);
+	return written;
+}
+
+/**
+ * Converts the spectrum into the batch, the element can be released
+ * afterwards.
+ */
+void
+FileSink::
+add(unsigned channel, SpectrumType* spectrum)
+{
+	const ElementInfo& info = Queue<SpectrumType>::info(spectrum);
+
+	FrameHeader& header = headers[batch];
+	header.magic = magic;
+	header.version = FrameHeader::Version;
+	header.channel = channel;
+	header.samplingRate = samplingRate;
+	header.binCount = binCount;
+	header.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			info.captureTime.time_since_epoch()).count();
+	header.lostFrames = info.lostFrames;
+	header.startFrequency = axis.start;
+	header.resolution = axis.step;
+
+	float* values = bins.data() + batch * binCount;
+	for (unsigned i = 0; i < binCount; i++) {
+		values[i] = spectrum[i];
+	}
+
+	iov[iovCount].iov_base = &header;
+	iov[iovCount].iov_len = sizeof(header);
+	iov[iovCount + 1].iov_base = values;
+	iov[iovCount + 1].iov_len = binCount * sizeof(float);
+	iovCount += 2;
+
+	if (peakFinder) {
+		addPeaks(header, spectrum);
+	}
+	batch++;
+}
+
+void
+FileSink::
+addPeaks(const FrameHeader& spectrumHeader,
+		const SpectrumType* spectrum)
+{
+	const Peaks& peaks = peakFinder->find(spectrum);
+
+	FrameHeader& header = peakHeaders[batch];
+	header = spectrumHeader;
+	header.magic = FrameHeader::PeakMagic;
+	header.binCount = peaks.peaks.size();
+
+	double* values = peakValues.data() + batch * peakStride;
+	values[0] = peaks.noiseFloor;
+	values[1] = peaks.thd;
+	memcpy(values + 2, peaks.peaks.data(), peaks.peaks.size() * sizeof(Peak));
+
+	iov[iovCount].iov_base = &header;
+	iov[iovCount].iov_len = sizeof(header);
+	iov[iovCount + 1].iov_base = values;
+	iov[iovCount + 1].iov_len = (2 + 3 * peaks.peaks.size()) * sizeof(double);
+	iovCount += 2;
+}
+
+void
+FileSink::
+flush()
+{
+	// an idle pass would record a write of nothing and skew the percentiles
+	if (iovCount == 0) {
+		return;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	::iovec* next = iov.data();
+	unsigned count = iovCount;
+	while (count > 0) {
+		ssize_t result = ::writev(fd, next, count);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			throwError("write", fileName);
+		}
+
+		// skip what has been written, a socket might take only part of it
+		std::size_t done = result;
+		while (count > 0 && done >= next->iov_len) {
+			done -= next->iov_len;
+			next++;
+			count--;
+		}
+		if (count > 0) {
+			next->iov_base = (uint8_t*) next->iov_base + done;
+			next->iov_len -= done;
+		}
+	}
+	batch = 0;
+	iovCount = 0;
+	writeTimes.record(std::chrono::steady_clock::now() - start);
+}
+
+} // namespace
@@ -0,0 +1,145 @@
+
+#ifndef __FILE_SINK__H
+#define __FILE_SINK__H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "utils/histogram.h"
+#include "utils/logger.h"
+#include "utils/queue.h"
+#include "peak_finder.h"
+
+namespace ockl {
+
+/**
+ * Header in front of every spectrum written by the FileSink, followed by
+ * binCount float32 values. All fields are native endian (little endian on
+ * the machines we run on), the layout has no padding.
+ *
+ * With the peak finder enabled every spectrum frame is followed by a peak
+ * frame: the same header with PeakMagic and binCount the number of peaks,
+ * followed by the noise floor and the THD (two float64) and the peaks
+ * (frequency, level, SNR as float64 each, see Peak).
+ *
+ * The logarithmic spectra of MultiResolution are written as LogMagic frames,
+ * with resolution the ratio of the frequencies of neighbouring bins (see
+ * FrequencyAxis). A ToneBank writes ToneMagic frames instead: binCount is the number of
+ * tones and the values are their levels, in the order the frequencies were
+ * given. startFrequency is 0 and resolution is the width of the fft bin
+ * of the same window length.
+ */
+struct FrameHeader {
+	static const uint32_t Magic = 0x43455053; // "SPEC"
+	static const uint32_t PeakMagic = 0x4b414550; // "PEAK"
+	static const uint32_t LogMagic = 0x474f4c53; // "SLOG"
+	static const uint32_t ToneMagic = 0x454e4f54; // "TONE"
+	static const uint16_t Version = 1;
+
+	uint32_t magic;
+	uint16_t version;
+	uint16_t channel;
+	uint32_t samplingRate;
+	uint32_t binCount;
+	/**
+	 * capture time [ns since the epoch] (for files: since the start of the
+	 * file), see ElementInfo
+	 */
+	uint64_t timestamp;
+	/**
+	 * frames lost right before this spectrum, see ElementInfo
+	 */
+	uint64_t lostFrames;
+	/**
+	 * frequency of the first bin [Hz]
+	 */
+	double startFrequency;
+	/**
+	 * distance of the bins [Hz], or their ratio for LogMagic frames
+	 */
+	double resolution;
+};
+
+static_assert(sizeof(FrameHeader) == 48, "FrameHeader must not be padded");
+
+/**
+ * Headless replacement of the Ui: streams the spectra of all channels as
+ * frames (FrameHeader + float32 bins) to a file or to a listening Unix
+ * domain socket. The frames which are ready are collected and written with
+ * a single writev, so a busy sink makes one system call per batch instead
+ * of one per spectrum.
+ */
+class FileSink {
+public:
+	/**
+	 * \param fileName      path of the output file, or of the socket if
+	 *                      prefixed with "unix:"
+	 * \param queues        one queue per channel, all with the same element
+	 *                      size
+	 * \param tones         the queues deliver tone levels from a ToneBank
+	 *                      instead of spectra
+	 * \param axis          frequencies of the bins
+	 * \param scale         scale of the spectra, for the peak finder
+	 * \param writeTimes    gets the time every batch takes to write
+	 */
+	FileSink(const std::string& fileName,
+			const std::vector<Queue<SpectrumType>*>& queues,
+			bool tones,
+			unsigned samplingRate,
+			const FrequencyAxis& axis,
+			Scale scale,
+			const PeakSettings& peakSettings,
+			Histogram& writeTimes,
+			const Logger& logger);
+	~FileSink();
+
+	/**
+	 * Writes until every queue has delivered its end of stream marker or
+	 * until `interrupted` is set.
+	 * \return  the number of spectra written (all channels)
+	 * \throws std::runtime_error if the output cannot be opened or written
+	 */
+	uint64_t run(const std::atomic<bool>& interrupted);
+
+private:
+	static const unsigned MaxBatch = 32;
+
+	void open();
+	void add(unsigned channel, SpectrumType* spectrum);
+	void addPeaks(const FrameHeader& spectrumHeader,
+			const SpectrumType* spectrum);
+	void flush();
+
+	const std::string fileName;
+	std::vector<Queue<SpectrumType>*> queues;
+	unsigned binCount;
+	uint32_t magic;
+	unsigned samplingRate;
+	FrequencyAxis axis;
+
+	int fd;
+	std::vector<FrameHeader> headers;
+	std::vector<float> bins;
+	std::unique_ptr<PeakFinder> peakFinder;
+	std::vector<FrameHeader> peakHeaders;
+	unsigned peakStride;
+	/**
+	 * noise floor, thd and peaks of every spectrum in the batch
+	 */
+	std::vector<double> peakValues;
+	std::vector<::iovec> iov;
+	unsigned iovCount;
+	unsigned batch;
+
+	Histogram& writeTimes;
+	const Logger& logger;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,116 @@
+
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <chrono>
+
+#include "file_source.h"
+
+namespace ockl {
+
+FileSource::
+FileSource(const AudioFile& file,
+		const std::vector<Queue<SamplingType>*>& queues,
+		const Logger& logger)
+: file(file),
+  queues(queues),
+  channels(queues.size()),
+  elementSize(queues.front()->getElementSize()),
+  logger(logger),
+  thread(nullptr),
+  doShutdown(false)
+{
+	if (channels > file.getChannels()) {
+		std::ostringstream oss;
+		oss << "file has " << file.getChannels() << " channels, " << channels
+				<< " requested";
+		throw std::runtime_error(oss.str());
+	}
+}
+
+FileSource::
+~FileSource()
+{
+	if (thread != nullptr) {
+		doShutdown = true;
+		thread->join();
+		delete thread;
+		thread = nullptr;
+	}
+}
+
+void
+FileSource::
+start()
+{
+	thread = new std::thread(&FileSource::threadFunction, this);
+	pthread_setname_np(thread->native_handle(), "file");
+}
+
+void
+FileSource::
+shutdown()
+{
+	doShutdown = true;
+}
+
+void
+FileSource::
+threadFunction()
+{
+	std::vector<SamplingType*> buffers(channels);
+	uint64_t frames = file.getFrames();
+	uint64_t samplingRate = std::max(1u, file.getSamplingRate());
+	uint64_t position = 0;
+
+	// An empty file still gets its end of stream marker.
+	do {
+		if (!allocate(buffers)) {
+			break;
+		}
+
+		std::chrono::system_clock::time_point captureTime(
+				std::chrono::microseconds(position * 1000000 / samplingRate));
+		unsigned count = std::min<uint64_t>(elementSize, frames - position);
+		for (unsigned channel = 0; channel < channels; channel++) {
+			file.read(position, channel, buffers[channel], count);
+			std::fill(buffers[channel] + count, buffers[channel] + elementSize, 0);
+		}
+		position += count;
+
+		for (unsigned channel = 0; channel < channels; channel++) {
+			ElementInfo& info = Queue<SamplingType>::info(buffers[channel]);
+			info.endOfStream = position == frames;
+			info.padding = elementSize - count;
+			info.captureTime = captureTime;
+			queues[channel]->push_back(buffers[channel]);
+		}
+	} while (position < frames);
+
+	LOGGER_INFO("file thread exiting after " << position << " frames");
+}
+
+/**
+ * Waits for an element in every queue, until shutdown.
+ */
+bool
+FileSource::
+allocate(std::vector<SamplingType*>& buffers)
+{
+	for (unsigned channel = 0; channel < channels; channel++) {
+		buffers[channel] = nullptr;
+		while (buffers[channel] == nullptr && !doShutdown) {
+			buffers[channel] = queues[channel]->allocate();
+		}
+		if (buffers[channel] == nullptr) {
+			// from the producer side, the consumers release to the pools
+			for (unsigned i = 0; i < channel; i++) {
+				queues[i]->unallocate(buffers[i]);
+			}
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace
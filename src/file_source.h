@@ -0,0 +1,54 @@
+
+#ifndef __FILE_SOURCE__H
+#define __FILE_SOURCE__H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "utils/logger.h"
+#include "utils/queue.h"
+#include "audio_file.h"
+#include "defs.h"
+
+namespace ockl {
+
+/**
+ * Feeds the channels of an AudioFile into one queue per channel, just like
+ * Alsa does for a device, but as fast as the consumers take the elements:
+ * when a queue is full the source waits instead of dropping. The last
+ * element is zero padded and marked endOfStream.
+ */
+class FileSource {
+public:
+	/**
+	 * \param file    an opened file with at least as many channels as
+	 *                there are queues
+	 * \param queues  one queue per channel, all with the same element size
+	 */
+	FileSource(const AudioFile& file,
+			const std::vector<Queue<SamplingType>*>& queues,
+			const Logger& logger);
+	~FileSource();
+
+	void start();
+	void shutdown();
+
+private:
+	void threadFunction();
+	bool allocate(std::vector<SamplingType*>& buffers);
+
+	const AudioFile& file;
+	std::vector<Queue<SamplingType>*> queues;
+	unsigned channels;
+	unsigned elementSize;
+
+	const Logger& logger;
+
+	std::thread* thread;
+	std::atomic<bool> doShutdown;
+};
+
+} // namespace
+
+#endif
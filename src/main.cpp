@@ -1,29 +1,139 @@
 
+#include <algorithm>
 #include <cstdlib>
 #include <stdexcept>
 #include <iostream>
 #include <signal.h>
+#include <unistd.h>
 #include <atomic>
 #include <chrono>
 #include <mutex>
 #include <condition_variable>
+#include <limits>
+#include <memory>
+#include <vector>
 
+#include "utils/histogram.h"
 #include "utils/logger.h"
+#include "utils/metrics.h"
 #include "utils/queue.h"
+#include "utils/realtime.h"
 #include "utils/watchdog.h"
 #include "alsa.h"
+#include "averager.h"
+#include "audio_file.h"
+#include "calibration.h"
+#include "file_sink.h"
+#include "file_source.h"
 #include "fft.h"
+#include "multi_resolution.h"
+#include "peak_finder.h"
+#include "tone_bank.h"
+#include "window.h"
+#include "zoom.h"
 #include "defs.h"
 #include "ui/ui.h"
 
 void usage(const char* arg0)
 {
 	std::cerr << "usage: " << arg0
-			<< " <pcm device> <sampling rate [Hz]> <input length [ms]>"
-			<< std::endl;
+			<< " [options] <pcm device | file> <sampling rate [Hz]> <input length [ms]>"
+			<< std::endl
+			<< "options:" << std::endl
+			<< "  -a <averaging>    linear:<frames>, exponential:<alpha>, "
+			<< "cumulative," << std::endl
+			<< "                    max-hold, min-hold, none (default)"
+			<< std::endl
+			<< "  -A <thread>:<cpus>" << std::endl
+			<< "                    pin the alsa, fft or logger threads to cpus, "
+			<< "e.g. fft:2,4-5" << std::endl
+			<< "  -c <channels>     number of channels to capture, 1-64 "
+			<< "(default 1)" << std::endl
+			<< "  -D                power spectral density (Welch), averaged "
+			<< "cumulative unless -a" << std::endl
+			<< "  -f                analyze a file instead of a pcm device, WAV "
+			<< "(the sampling rate" << std::endl
+			<< "                    argument is ignored) or raw, see -r"
+			<< std::endl
+			<< "  -F <format>       sample format of the pcm device: s16, s24, "
+			<< "s32, float" << std::endl
+			<< "                    (default: the widest the device supports)"
+			<< std::endl
+			<< "  -r <format>       raw file of interleaved s16, s24, s32 or "
+			<< "float samples" << std::endl
+			<< "  -g <rows>         show a spectrogram of the last <rows> spectra "
+			<< "(at most 4096)" << std::endl
+			<< "  -H <file>         headless: stream the spectra to a file (or to "
+			<< "a Unix socket," << std::endl
+			<< "                    unix:<path>) instead of plotting" << std::endl
+			<< "  -j <workers>      fft threads per channel, 1-64 (default 1)"
+			<< std::endl
+			<< "  -k <peaks>        mark the strongest peaks, with SNR and THD "
+			<< "(default 0)" << std::endl
+			<< "  -K <method>       peak interpolation: parabolic, gaussian "
+			<< "(default)" << std::endl
+			<< "  -L                lock all memory (mlockall), nothing is "
+			<< "paged out" << std::endl
+			<< "  -m                capture via mmap instead of snd_pcm_readi"
+			<< std::endl
+			<< "  -M <bands>[:<points per octave>]" << std::endl
+			<< "                    multi-resolution: octave bands with ffts of "
+			<< "the input length," << std::endl
+			<< "                    merged into a logarithmic spectrum (default "
+			<< "24 points)," << std::endl
+			<< "                    instead of the linear spectrum" << std::endl
+			<< "  -o <overlap [%]>  overlap of consecutive fft frames (default 0)"
+			<< std::endl
+			<< "  -w <window>       rectangular (default), hann, "
+			<< "blackman-harris, flat-top" << std::endl
+			<< "  -s <scale>        magnitude, power, db (default)" << std::endl
+			<< "  -u <unit>         sample (default), fs (full scale), "
+			<< "v:<peak volts at full scale>" << std::endl
+			<< "  -T <f1,f2,...>    headless only: follow the levels of these "
+			<< "frequencies [Hz]" << std::endl
+			<< "                    with a sliding dft instead of running ffts"
+			<< std::endl
+			<< "  -X <file>         write latency percentiles of the stages to "
+			<< "<file> every 10 s" << std::endl
+			<< "                    (Prometheus text format)" << std::endl
+			<< "  -p <period [ms]>  period time of the alsa device, 1-1000 "
+			<< "(default 5)" << std::endl
+			<< "  -P <planner>      fftw planner: estimate, measure (default), "
+			<< "patient" << std::endl
+			<< "  -R <priority>     SCHED_FIFO priority (1-99) of the alsa "
+			<< "thread" << std::endl
+			<< "  -W <file>         fftw wisdom cache (default "
+			<< "~/.spectrum_analyzer.wisdom, \"\" to disable)" << std::endl
+			<< "  -z <centre [Hz]>:<decimation>" << std::endl
+			<< "                    zoom into the band of sampling rate / "
+			<< "decimation around centre" << std::endl;
 }
 
 const unsigned QueueLength = 10;
+/**
+ * the waterfall holds an image of this many rows per channel
+ */
+const unsigned MaxWaterfallRows = 4096;
+/**
+ * every channel gets its own queues and threads
+ */
+const unsigned MaxChannels = 64;
+/**
+ * fft threads per channel
+ */
+const unsigned MaxWorkers = 64;
+/**
+ * [ms], a longer alsa period only adds latency
+ */
+const unsigned MaxPeriodTime = 1000;
+
+std::atomic<bool> interrupted(false);
+
+void
+onInterrupt(int)
+{
+	interrupted = true;
+}
 
 unsigned
 roundToNearestPowerOf2(unsigned value)
@@ -41,19 +151,207 @@ roundToNearestPowerOf2(unsigned value)
 	return (counter - value < value - counter / 2 ? counter : counter / 2);
 }
 
+/**
+ * Parses a number in the range [minimum, maximum]. std::stoul alone would
+ * take "-1" for the largest value.
+ * \throws std::invalid_argument, std::out_of_range
+ */
+unsigned
+parseCount(const std::string& value, unsigned minimum, unsigned maximum)
+{
+	if (value.find('-') != std::string::npos) {
+		throw std::out_of_range(value);
+	}
+	unsigned long count = std::stoul(value);
+	if (count < minimum || count > maximum) {
+		throw std::out_of_range(value);
+	}
+	return count;
+}
+
 int main(int argc, char** argv)
 {
-	if (argc < 4) {
+	unsigned channels = 1;
+	unsigned workers = 1;
+	bool useMmap = false;
+	unsigned overlap = 0;
+	unsigned periodTime = 5;
+	unsigned waterfallRows = 0;
+	ockl::Window window = ockl::Window::Rectangular;
+	ockl::Scale scale = ockl::Scale::Decibel;
+	ockl::AveragingSettings averaging{ockl::Averaging::None, 1, 1.0};
+	bool averagingGiven = false;
+	ockl::Calibration calibration{ockl::Unit::Sample, 1.0, false};
+	ockl::PeakSettings peakSettings{0, ockl::Interpolation::Gaussian};
+	ockl::Planner planner = ockl::Planner::Measure;
+	ockl::ZoomSettings zoom{0, 1};
+	std::vector<double> tones;
+	// the rest is filled in once the fft size is known
+	ockl::MultiResolutionSettings multiResolution{0, 24, 0, 0,
+		ockl::Window::Rectangular, ockl::Scale::Decibel, ockl::Planner::Measure,
+		"", false};
+	bool fileInput = false;
+	bool rawFile = false;
+	ockl::SampleFormat rawFormat = ockl::SampleFormat::S16;
+	// the widest format the device supports, unless one is forced
+	std::vector<ockl::SampleFormat> captureFormats{ockl::SampleFormat::S32,
+		ockl::SampleFormat::S24, ockl::SampleFormat::Float,
+		ockl::SampleFormat::S16};
+	ockl::ThreadSettings alsaThread{0, {}};
+	ockl::ThreadSettings fftThread{0, {}};
+	ockl::ThreadSettings loggerThread{0, {}};
+	bool memoryLocked = false;
+	std::string outputFile;
+	std::string metricsFile;
+	std::string wisdomFile;
+	if (getenv("HOME") != nullptr) {
+		wisdomFile = std::string(getenv("HOME")) + "/.spectrum_analyzer.wisdom";
+	}
+
+	int option;
+	while ((option = getopt(argc, argv, "a:A:c:DfF:g:j:k:K:LmM:o:p:r:R:w:s:u:H:P:T:W:X:z:")) != -1) {
+		try {
+			switch (option) {
+			case 'a':
+				averaging = ockl::parseAveraging(optarg);
+				averagingGiven = true;
+				break;
+			case 'A': {
+				std::string thread;
+				std::vector<unsigned> cpus;
+				ockl::parseAffinity(optarg, thread, cpus);
+				if (thread == "alsa") {
+					alsaThread.cpus = cpus;
+				} else if (thread == "fft") {
+					fftThread.cpus = cpus;
+				} else if (thread == "logger") {
+					loggerThread.cpus = cpus;
+				} else {
+					throw std::out_of_range("thread");
+				}
+				break;
+			}
+			case 'c':
+				channels = parseCount(optarg, 1, MaxChannels);
+				break;
+			case 'D':
+				calibration.density = true;
+				break;
+			case 'f':
+				fileInput = true;
+				break;
+			case 'F':
+				captureFormats = {ockl::parseSampleFormat(optarg)};
+				break;
+			case 'g':
+				waterfallRows = parseCount(optarg, 0, MaxWaterfallRows);
+				break;
+			case 'j':
+				workers = parseCount(optarg, 1, MaxWorkers);
+				break;
+			case 'k':
+				peakSettings.count = parseCount(optarg, 0,
+						std::numeric_limits<unsigned>::max());
+				break;
+			case 'K':
+				peakSettings.interpolation = ockl::parseInterpolation(optarg);
+				break;
+			case 'L':
+				memoryLocked = true;
+				break;
+			case 'm':
+				useMmap = true;
+				break;
+			case 'M':
+				ockl::parseMultiResolution(optarg, multiResolution);
+				break;
+			case 'o':
+				overlap = std::stoi(optarg);
+				if (overlap >= 100) {
+					throw std::out_of_range("overlap");
+				}
+				break;
+			case 'p':
+				periodTime = parseCount(optarg, 1, MaxPeriodTime);
+				break;
+			case 'r':
+				rawFile = true;
+				rawFormat = ockl::parseSampleFormat(optarg);
+				break;
+			case 'R':
+				alsaThread.priority = std::stoi(optarg);
+				if (alsaThread.priority < 1 || alsaThread.priority > 99) {
+					throw std::out_of_range("priority");
+				}
+				break;
+			case 'w':
+				window = ockl::parseWindow(optarg);
+				break;
+			case 's':
+				scale = ockl::parseScale(optarg);
+				break;
+			case 'u':
+				ockl::parseUnit(optarg, calibration);
+				break;
+			case 'H':
+				outputFile = optarg;
+				break;
+			case 'P':
+				planner = ockl::parsePlanner(optarg);
+				break;
+			case 'T':
+				tones = ockl::parseTones(optarg);
+				break;
+			case 'W':
+				wisdomFile = optarg;
+				break;
+			case 'X':
+				metricsFile = optarg;
+				break;
+			case 'z':
+				zoom = ockl::parseZoom(optarg);
+				break;
+			default:
+				usage(argv[0]);
+				return -1;
+			}
+		} catch (...) {
+			std::cerr << "failed to parse option -" << (char) option << std::endl;
+			usage(argv[0]);
+			return -1;
+		}
+	}
+
+	if (argc - optind < 3) {
 		usage(argv[0]);
 		return -1;
 	}
+	if (!tones.empty() && (outputFile.empty() || zoom.decimation > 1)) {
+		std::cerr << "-T needs -H and does not combine with -z" << std::endl;
+		return -1;
+	}
+	if (multiResolution.bands > 0 && (zoom.decimation > 1 || !tones.empty())) {
+		std::cerr << "-M does not combine with -z or -T" << std::endl;
+		return -1;
+	}
+	bool calibrated = ockl::isCalibrated(calibration);
+	if (calibrated && (zoom.decimation > 1 || !tones.empty()
+			|| multiResolution.bands > 0)) {
+		std::cerr << "-u and -D do not combine with -z, -T or -M" << std::endl;
+		return -1;
+	}
+	// Welch's method: the mean of the densities of all frames so far
+	if (calibration.density && !averagingGiven) {
+		averaging.mode = ockl::Averaging::Cumulative;
+	}
 
+	const char* deviceName = argv[optind];
 	unsigned samplingRate;
 	std::chrono::microseconds inputLength;
 
 	try {
-		samplingRate = std::stoi(argv[2]);
-		inputLength = std::chrono::microseconds(std::stoi(argv[3]) * 1000);
+		samplingRate = std::stoi(argv[optind + 1]);
+		inputLength = std::chrono::microseconds(std::stoi(argv[optind + 2]) * 1000);
 	} catch (...) {
 		std::cerr << "failed to parse arguments" << std::endl;
 		usage(argv[0]);
@@ -62,69 +360,361 @@ int main(int argc, char** argv)
 
 	ockl::Logger logger;
 
-	// Convert input length [us] (period time in alsa speak) to sample
-	// count [frames] (period size in alsa speak, aka fft length) and round
-	// it up/down such that it is a power of 2 (which makes the fft faster).
+	// Before anything big is allocated, so the queues and fft buffers are
+	// locked (and faulted in) as they are allocated.
+	try {
+		logger.configure(loggerThread);
+		if (memoryLocked) {
+			ockl::lockMemory();
+			LOGGER_INFO("memory locked");
+		}
+	} catch (const std::runtime_error& ex) {
+		LOGGER_ERROR("realtime setup failed: " << ex.what());
+		return -2;
+	}
+
+	std::unique_ptr<ockl::AudioFile> file;
+	if (fileInput) {
+		try {
+			file.reset(new ockl::AudioFile(deviceName, logger));
+			if (rawFile) {
+				file->open(rawFormat, channels, samplingRate);
+			} else {
+				file->open();
+				samplingRate = file->getSamplingRate();
+			}
+		} catch (const std::runtime_error& ex) {
+			LOGGER_ERROR("open failed: " << ex.what());
+			return -2;
+		}
+	}
+
+	// Convert input length [us] to sample count [frames] (aka fft length)
+	// and round it up/down such that it is a power of 2 (which makes the fft
+	// faster). Zooming transforms the decimated complex samples, which cover
+	// the whole band (no mirror image), so every sample gives a bin.
+	bool zoomed = zoom.decimation > 1;
+	double fftRate = (double) samplingRate / zoom.decimation;
 	unsigned sampleCount = roundToNearestPowerOf2((unsigned)
-			((uint64_t) inputLength.count() * (uint64_t) samplingRate / 1e6));
-	double fftResolution = (double) samplingRate / (double) sampleCount;
-	unsigned fftBinCount = sampleCount / 2 + 1;
+			((uint64_t) inputLength.count() * fftRate / 1e6));
+	double fftResolution = fftRate / (double) sampleCount;
+	// the tone bank delivers one level per tone instead of a spectrum
+	bool toneBank = !tones.empty();
+	unsigned fftBinCount = toneBank ? tones.size()
+			: zoomed ? sampleCount : sampleCount / 2 + 1;
+	double startFrequency = zoomed
+			? zoom.centerFrequency - fftResolution * (sampleCount / 2) : 0;
+	unsigned hopSize = std::max(1u, sampleCount * (100 - overlap) / 100);
+	bool multiResolved = multiResolution.bands > 0;
+	multiResolution.fftSize = sampleCount;
+	multiResolution.hopSize = hopSize;
+	if (multiResolved) {
+		fftBinCount = ockl::MultiResolution::binCount(multiResolution,
+				samplingRate);
+	}
+	ockl::FrequencyAxis axis = multiResolved
+			? ockl::MultiResolution::axis(multiResolution, samplingRate)
+			: ockl::FrequencyAxis{startFrequency, fftResolution, false};
+	// there cannot be more peaks than bins
+	peakSettings.count = std::min(peakSettings.count, fftBinCount);
+	// The alsa period is independent of the fft length, alsa collects
+	// the periods into elements of one hop each.
+	unsigned periodSize = std::max(1u, samplingRate * periodTime / 1000);
+	// Buffer as many samples as before, no matter how small the hop is.
+	unsigned fftQueueLength = QueueLength * sampleCount / hopSize;
 
 	LOGGER_INFO("sample count: " << sampleCount << " [frames]");
 	LOGGER_INFO("input length: " <<
-			(double) sampleCount / (double) samplingRate * 1000 << " [ms]");
+			(double) sampleCount / fftRate * 1000 << " [ms]");
 	LOGGER_INFO("fft resolution: " << fftResolution << " [Hz/bin]");
 
-	ockl::Queue<ockl::SamplingType> fftQueue(sampleCount, QueueLength,
-			ockl::Timeout);
-
-	ockl::Queue<double> uiQueue(fftBinCount, QueueLength,
-			ockl::Timeout);
+	// Every channel gets its own pair of queues and its own fft thread, so
+	// the channels are transformed in parallel. Zooming adds a stage (and a
+	// queue) between capture and fft, averaging one between fft and ui.
+	// the calibration is applied by the averager stage as well
+	bool averaged = averaging.mode != ockl::Averaging::None || calibrated;
+	std::vector<double> calibrationFactors;
+	if (calibrated) {
+		calibrationFactors = ockl::calibrationFactors(calibration, window,
+				sampleCount, samplingRate);
+	}
+	std::vector<std::unique_ptr<ockl::Queue<ockl::SamplingType>>> fftQueues;
+	std::vector<std::unique_ptr<ockl::Queue<double>>> zoomQueues;
+	std::vector<std::unique_ptr<ockl::Queue<ockl::SpectrumType>>> averagerQueues;
+	std::vector<std::unique_ptr<ockl::Queue<ockl::SpectrumType>>> uiQueues;
+	for (unsigned channel = 0; channel < channels; channel++) {
+		// with zooming a capture element decimates to one hop
+		fftQueues.emplace_back(new ockl::Queue<ockl::SamplingType>(
+				hopSize * zoom.decimation, fftQueueLength, ockl::Timeout));
+		if (zoomed) {
+			zoomQueues.emplace_back(new ockl::Queue<double>(
+					2 * hopSize, fftQueueLength, ockl::Timeout));
+		}
+		if (averaged) {
+			averagerQueues.emplace_back(new ockl::Queue<ockl::SpectrumType>(
+					fftBinCount, QueueLength, ockl::Timeout));
+		}
+		uiQueues.emplace_back(new ockl::Queue<ockl::SpectrumType>(
+				fftBinCount, QueueLength, ockl::Timeout));
+	}
 
 	ockl::Watchdog watchdog(std::chrono::seconds(10),
 			std::chrono::duration_cast<std::chrono::milliseconds>(inputLength),
 			logger);
-	watchdog.addQueue(&fftQueue, "fft");
-	watchdog.addQueue(&uiQueue, "ui");
-
-	ockl::Alsa alsa(
-			argv[1],
-			samplingRate,
-			sampleCount,
-			fftQueue,
-			logger);
+	// A file is read as fast as the queues allow, so they are always full
+	// and there is nothing to watch.
+	for (unsigned channel = 0; channel < channels && !file; channel++) {
+		std::string suffix = channels == 1 ? "" : " " + std::to_string(channel);
+		if (zoomed) {
+			watchdog.addQueue(fftQueues[channel].get(), "zoom" + suffix);
+			watchdog.addQueue(zoomQueues[channel].get(), "fft" + suffix);
+		} else {
+			watchdog.addQueue(fftQueues[channel].get(),
+					(toneBank ? "tones" : multiResolved ? "multires" : "fft")
+					+ suffix);
+		}
+		if (averaged) {
+			watchdog.addQueue(averagerQueues[channel].get(), "averager" + suffix);
+		}
+		watchdog.addQueue(uiQueues[channel].get(), "ui" + suffix);
+	}
 
-	ockl::Fft fft(sampleCount,
-			fftQueue,
-			uiQueue,
-			logger);
+	std::vector<ockl::Queue<ockl::SamplingType>*> alsaQueues;
+	std::vector<ockl::Queue<ockl::SpectrumType>*> displayQueues;
+	std::vector<std::unique_ptr<ockl::Zoom>> zooms;
+	std::vector<std::unique_ptr<ockl::Fft>> ffts;
+	std::vector<std::unique_ptr<ockl::ToneBank>> toneBanks;
+	std::vector<std::unique_ptr<ockl::MultiResolution>> multiResolutions;
+	std::vector<std::unique_ptr<ockl::Averager>> averagers;
+	// Without the ui nobody needs to skip spectra, offline every frame is
+	// analyzed.
+	bool headless = !outputFile.empty();
+	bool lossless = headless && fileInput;
+	// averages are taken over power, the averager converts to the scale
+	ockl::FftSettings fftSettings{sampleCount, hopSize, window,
+		averaged ? ockl::Scale::Power : scale, planner, wisdomFile, workers,
+		lossless, fftThread};
+	ockl::ToneSettings toneSettings{tones, sampleCount, hopSize, window,
+		fftSettings.scale, lossless};
+	multiResolution.window = window;
+	multiResolution.scale = fftSettings.scale;
+	multiResolution.planner = planner;
+	multiResolution.wisdomFile = wisdomFile;
+	multiResolution.lossless = lossless;
+	for (unsigned channel = 0; channel < channels; channel++) {
+		alsaQueues.push_back(fftQueues[channel].get());
+		displayQueues.push_back(uiQueues[channel].get());
+		ockl::Queue<ockl::SpectrumType>& fftOutQueue = averaged
+				? *averagerQueues[channel] : *uiQueues[channel];
+		// the input queues have a single consumer, -M and -T replace the fft
+		if (multiResolved) {
+			multiResolutions.emplace_back(new ockl::MultiResolution(
+					multiResolution,
+					samplingRate,
+					*fftQueues[channel],
+					fftOutQueue,
+					logger));
+		} else if (toneBank) {
+			toneBanks.emplace_back(new ockl::ToneBank(toneSettings,
+					samplingRate,
+					*fftQueues[channel],
+					fftOutQueue,
+					logger));
+		} else if (zoomed) {
+			zooms.emplace_back(new ockl::Zoom(zoom, samplingRate, lossless,
+					*fftQueues[channel],
+					*zoomQueues[channel],
+					logger));
+			ffts.emplace_back(new ockl::Fft(fftSettings,
+					*zoomQueues[channel],
+					fftOutQueue,
+					logger));
+		} else {
+			ffts.emplace_back(new ockl::Fft(fftSettings,
+					*fftQueues[channel],
+					fftOutQueue,
+					logger));
+		}
+		if (averaged) {
+			averagers.emplace_back(new ockl::Averager(averaging, scale,
+					calibrationFactors,
+					lossless,
+					*averagerQueues[channel],
+					*uiQueues[channel],
+					logger));
+		}
+	}
+
+	std::unique_ptr<ockl::Alsa> alsa;
+	std::unique_ptr<ockl::FileSource> fileSource;
+	// written to by the ui or the file sink
+	ockl::Histogram renderTimes;
+	// destroyed (and written a last time) before the stages it reports on
+	std::unique_ptr<ockl::Metrics> metrics;
 
 	try {
-		alsa.init();
-		fft.init();
+		if (file) {
+			fileSource.reset(new ockl::FileSource(*file, alsaQueues, logger));
+		} else {
+			alsa.reset(new ockl::Alsa(
+					deviceName,
+					samplingRate,
+					periodSize,
+					useMmap,
+					captureFormats,
+					alsaThread,
+					alsaQueues,
+					logger));
+			watchdog.addCapture(alsa.get(), "alsa");
+			alsa->init();
+		}
+		for (auto& zoom : zooms) {
+			zoom->init();
+		}
+		for (auto& fft : ffts) {
+			fft->init();
+		}
+		for (auto& toneBank : toneBanks) {
+			toneBank->init();
+		}
+		for (auto& multiResolution : multiResolutions) {
+			multiResolution->init();
+		}
 	} catch (const std::runtime_error& ex) {
 		LOGGER_ERROR("init failed: " << ex.what());
 		return -2;
 	}
 
+	if (!metricsFile.empty()) {
+		metrics.reset(new ockl::Metrics(metricsFile, std::chrono::seconds(10),
+				logger));
+		if (alsa) {
+			metrics->add("spectrum_analyzer_capture_latency_seconds",
+					"Time from capturing the first frame of an element to "
+					"queueing it", "", alsa->captureLatencies());
+		}
+		// the queues are named after their consumer, like in the watchdog
+		std::string output = headless ? "file" : "ui";
+		auto addHoldTimes = [&](const std::string& consumer, unsigned channel,
+				const ockl::Histogram& holdTimes) {
+			metrics->add("spectrum_analyzer_queue_hold_seconds",
+					"Time elements wait in a queue for the consumer",
+					"consumer=\"" + consumer + "\",channel=\""
+					+ std::to_string(channel) + "\"", holdTimes);
+		};
+		for (unsigned channel = 0; channel < channels; channel++) {
+			addHoldTimes(toneBank ? "tones" : multiResolved ? "multires"
+					: zoomed ? "zoom" : "fft", channel,
+					fftQueues[channel]->holdTimes());
+			if (zoomed) {
+				addHoldTimes("fft", channel, zoomQueues[channel]->holdTimes());
+			}
+			if (averaged) {
+				addHoldTimes("averager", channel,
+						averagerQueues[channel]->holdTimes());
+			}
+			addHoldTimes(output, channel, uiQueues[channel]->holdTimes());
+		}
+		for (unsigned channel = 0; channel < ffts.size(); channel++) {
+			metrics->add("spectrum_analyzer_fft_compute_seconds",
+					"Time to window, transform and convert one spectrum",
+					"channel=\"" + std::to_string(channel) + "\"",
+					ffts[channel]->computeTimes());
+		}
+		metrics->add("spectrum_analyzer_render_seconds",
+				"Time to draw or write the latest spectra",
+				"output=\"" + output + "\"", renderTimes);
+	}
+
+	auto startTime = std::chrono::steady_clock::now();
 	try {
-		alsa.start();
-		fft.start();
+		if (fileSource) {
+			fileSource->start();
+		} else {
+			alsa->start();
+		}
+		for (auto& zoom : zooms) {
+			zoom->start();
+		}
+		for (auto& fft : ffts) {
+			fft->start();
+		}
+		for (auto& toneBank : toneBanks) {
+			toneBank->start();
+		}
+		for (auto& multiResolution : multiResolutions) {
+			multiResolution->start();
+		}
+		for (auto& averager : averagers) {
+			averager->start();
+		}
 	} catch (const std::runtime_error& ex) {
 		LOGGER_ERROR("start failed: " << ex.what());
 		return -3;
 	}
 
-	ockl::Ui ui;
-	ui.run(uiQueue, logger, fftResolution);
+	int result = 0;
+	if (headless) {
+		signal(SIGINT, onInterrupt);
+		signal(SIGTERM, onInterrupt);
+		// a vanished socket reader shows up as a write error instead
+		signal(SIGPIPE, SIG_IGN);
+		try {
+			ockl::FileSink sink(outputFile, displayQueues, toneBank,
+					samplingRate, axis, scale, peakSettings, renderTimes,
+					logger);
+			sink.run(interrupted);
+		} catch (const std::runtime_error& ex) {
+			LOGGER_ERROR("output failed: " << ex.what());
+			result = -4;
+		}
+		if (file && !interrupted && result == 0) {
+			double elapsed = std::chrono::duration<double>(
+					std::chrono::steady_clock::now() - startTime).count();
+			double duration = (double) file->getFrames() / samplingRate;
+			LOGGER_INFO("analyzed " << duration << " [s] of input in "
+					<< elapsed << " [s] (" << duration / elapsed
+					<< " x real time)");
+		}
+	} else {
+		ockl::Ui ui;
+		ui.run(displayQueues, logger, axis, scale, calibration,
+				waterfallRows, peakSettings, renderTimes);
+	}
 
 	LOGGER_INFO("shutting down");
 
 	watchdog.shutdown();
-	fftQueue.shutdown();
-	uiQueue.shutdown();
-	fft.shutdown();
-	alsa.shutdown();
+	for (unsigned channel = 0; channel < channels; channel++) {
+		fftQueues[channel]->shutdown();
+		if (zoomed) {
+			zoomQueues[channel]->shutdown();
+		}
+		if (averaged) {
+			averagerQueues[channel]->shutdown();
+		}
+		uiQueues[channel]->shutdown();
+	}
+	for (auto& zoom : zooms) {
+		zoom->shutdown();
+	}
+	for (auto& fft : ffts) {
+		fft->shutdown();
+	}
+	for (auto& toneBank : toneBanks) {
+		toneBank->shutdown();
+	}
+	for (auto& multiResolution : multiResolutions) {
+		multiResolution->shutdown();
+	}
+	for (auto& averager : averagers) {
+		averager->shutdown();
+	}
+	if (fileSource) {
+		fileSource->shutdown();
+	} else {
+		alsa->shutdown();
+	}
 
-	return 0;
+	return result;
 }
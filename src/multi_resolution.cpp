@@ -0,0 +1,498 @@
+
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "multi_resolution.h"
+
+namespace ockl {
+
+void
+parseMultiResolution(const std::string& value,
+		MultiResolutionSettings& settings)
+{
+	std::size_t colon = value.find(':');
+	settings.bands = std::stoi(value.substr(0, colon));
+	settings.pointsPerOctave = colon == std::string::npos ? 24
+			: std::stoi(value.substr(colon + 1));
+	if (settings.bands == 0 || settings.bands > 16) {
+		throw std::runtime_error("bands must be in the range [1, 16]");
+	}
+	if (settings.pointsPerOctave == 0) {
+		throw std::runtime_error("at least one point per octave is needed");
+	}
+}
+
+MultiResolution::Decimator::
+Decimator()
+: history(HalfBandTaps),
+  odd(false)
+{
+}
+
+MultiResolution::Band::
+Band(unsigned fftSize)
+: history(fftSize),
+  out(nullptr),
+  thread(nullptr)
+{
+}
+
+MultiResolution::
+MultiResolution(const MultiResolutionSettings& settings,
+		unsigned samplingRate,
+		Queue<SamplingType>& inQueue,
+		Queue<SpectrumType>& outQueue,
+		const Logger& logger)
+: settings(settings),
+  samplingRate(samplingRate),
+  spectrumSize(settings.fftSize / 2 + 1),
+  pending(0),
+  windowGain(0),
+  merged(outQueue.getElementSize()),
+  samples(inQueue.getElementSize()),
+  in(nullptr),
+  plan(nullptr),
+  inQueue(inQueue),
+  outQueue(outQueue),
+  lostFrames(0),
+  droppedFrames(0),
+  logger(logger),
+  thread(nullptr),
+  mergeThread(nullptr),
+  doShutdown(false)
+{
+	// every band gets whole samples per hop
+	unsigned multiple = 1u << (settings.bands - 1);
+	this->settings.hopSize = (settings.hopSize + multiple - 1)
+			/ multiple * multiple;
+}
+
+MultiResolution::
+~MultiResolution()
+{
+	doShutdown = true;
+	if (thread != nullptr) {
+		thread->join();
+		delete thread;
+		thread = nullptr;
+	}
+	if (mergeThread != nullptr) {
+		mergeThread->join();
+		delete mergeThread;
+		mergeThread = nullptr;
+	}
+	for (unsigned index = 0; index < spectra.size(); index++) {
+		if (spectra[index] != nullptr) {
+			bands[index]->spectra->release(spectra[index]);
+		}
+	}
+	for (auto& band : bands) {
+		if (band->thread != nullptr) {
+			band->thread->join();
+			delete band->thread;
+		}
+		::FFTW(free)(band->out);
+	}
+	if (plan != nullptr) {
+		::FFTW(destroy_plan)(plan);
+	}
+	::FFTW(free)(in);
+}
+
+FrequencyAxis
+MultiResolution::
+axis(const MultiResolutionSettings& settings, unsigned samplingRate)
+{
+	// from the second bin of the finest band, below there is no resolution
+	// left to spread over an octave
+	double finest = (double) samplingRate
+			/ ((double) settings.fftSize * (1u << (settings.bands - 1)));
+	return FrequencyAxis{2 * finest, pow(2.0, 1.0 / settings.pointsPerOctave),
+		true};
+}
+
+unsigned
+MultiResolution::
+binCount(const MultiResolutionSettings& settings, unsigned samplingRate)
+{
+	FrequencyAxis frequencies = axis(settings, samplingRate);
+	return floor(frequencies.bin(samplingRate / 2.0)) + 1;
+}
+
+void
+MultiResolution::
+init()
+{
+	if (plan != nullptr) {
+		throw std::runtime_error("multi resolution already initialized");
+	}
+	if (settings.fftSize < 4) {
+		throw std::runtime_error("fft size must be at least 4");
+	}
+	if (outQueue.getElementSize() != binCount(settings, samplingRate)) {
+		throw std::runtime_error("output elements must hold the merged spectrum");
+	}
+
+	// half band low pass: Blackman windowed sinc with the cut off (-6 dB)
+	// at the new nyquist frequency, 0.25 of the input rate. It is flat up to
+	// 0.2 of the input rate (PassBand of the new nyquist frequency), the
+	// bins above are taken from the band before, and below -75 dB from 0.3,
+	// so only the unused part of the band aliases.
+	taps.resize(HalfBandTaps);
+	double center = (HalfBandTaps - 1) / 2.0;
+	double sum = 0;
+	for (unsigned i = 0; i < HalfBandTaps; i++) {
+		double t = i - center;
+		double window = 0.42 - 0.5 * cos(2 * M_PI * i / (HalfBandTaps - 1))
+				+ 0.08 * cos(4 * M_PI * i / (HalfBandTaps - 1));
+		taps[i] = sin(M_PI * t / 2) / (M_PI * t) * window;
+		sum += taps[i];
+	}
+	for (double& tap : taps) {
+		tap /= sum;
+	}
+
+	std::vector<double> table = makeWindow(settings.window, settings.fftSize);
+	windowTable.assign(table.begin(), table.end());
+	windowGain = 0;
+	for (double value : table) {
+		windowGain += value;
+	}
+
+	for (unsigned index = 0; index < settings.bands; index++) {
+		bands.emplace_back(new Band(settings.fftSize));
+		Band& band = *bands.back();
+		if (index + 1 < settings.bands) {
+			band.decimator.reset(new Decimator());
+			band.decimated.resize(samples.size() / 2 + 1);
+		}
+		// one frame being transformed, one waiting
+		band.frames.reset(new Queue<SpectrumType>(settings.fftSize, 2,
+				Timeout));
+		band.spectra.reset(new Queue<SpectrumType>(spectrumSize, 2, Timeout));
+		band.out = (::FFTW(complex)*) ::FFTW(malloc)(
+				sizeof(::FFTW(complex)) * spectrumSize);
+		if (band.out == nullptr) {
+			throw std::runtime_error("failed to allocate fft buffers");
+		}
+	}
+	spectra.assign(settings.bands, nullptr);
+
+	in = (SpectrumType*) ::FFTW(malloc)(
+			sizeof(SpectrumType) * settings.fftSize);
+	if (in == nullptr) {
+		throw std::runtime_error("failed to allocate fft buffers");
+	}
+	importWisdom(settings.wisdomFile, logger);
+	plan = ::FFTW(plan_dft_r2c_1d)(settings.fftSize, in, bands.front()->out,
+			plannerFlags(settings.planner));
+	if (plan == nullptr) {
+		throw std::runtime_error("failed to create fft plan");
+	}
+	exportWisdom(settings.wisdomFile, settings.planner, logger);
+
+	// Every bin of the merged spectrum comes from the finest band whose
+	// pass band still reaches its frequency.
+	FrequencyAxis frequencies = axis(settings, samplingRate);
+	double halfStep = sqrt(frequencies.step);
+	for (unsigned bin = 0; bin < merged.size(); bin++) {
+		double frequency = frequencies.frequency(bin);
+		unsigned index = settings.bands - 1;
+		while (index > 0 && frequency
+				> PassBand * samplingRate / (2u << index)) {
+			index--;
+		}
+		double resolution = (double) samplingRate
+				/ ((double) settings.fftSize * (1u << index));
+
+		Source source;
+		source.band = index;
+		source.first = ceil(frequency / halfStep / resolution);
+		source.last = std::min<double>(spectrumSize - 1,
+				floor(frequency * halfStep / resolution));
+		source.position = std::min<double>(spectrumSize - 1,
+				frequency / resolution);
+		sources.push_back(source);
+	}
+
+	LOGGER_INFO("multi resolution: " << settings.bands << " bands of "
+			<< settings.fftSize << " points, " << frequencies.start << " to "
+			<< samplingRate / 2 << " [Hz] in " << merged.size()
+			<< " bins, hop size: " << settings.hopSize << " [frames]");
+}
+
+void
+MultiResolution::
+start()
+{
+	if (plan == nullptr) {
+		throw std::runtime_error("multi resolution not initialized");
+	}
+
+	thread = new std::thread(&MultiResolution::threadFunction, this);
+	pthread_setname_np(thread->native_handle(), "multires");
+
+	for (unsigned index = 0; index < bands.size(); index++) {
+		bands[index]->thread = new std::thread(
+				&MultiResolution::bandFunction, this, index);
+		std::string name = "multires-" + std::to_string(index);
+		pthread_setname_np(bands[index]->thread->native_handle(),
+				name.c_str());
+	}
+
+	mergeThread = new std::thread(&MultiResolution::mergeFunction, this);
+	pthread_setname_np(mergeThread->native_handle(), "multires-merge");
+}
+
+void
+MultiResolution::
+shutdown()
+{
+	doShutdown = true;
+}
+
+void
+MultiResolution::
+threadFunction()
+{
+	unsigned periodSize = inQueue.getElementSize();
+
+	while (!doShutdown) {
+		SamplingType* inBuffer = inQueue.pop_front();
+		if (inBuffer == nullptr) {
+			continue;
+		}
+
+		const ElementInfo& info = Queue<SamplingType>::info(inBuffer);
+		unsigned valid = periodSize - info.padding;
+		captureTime = info.captureTime;
+		if (info.lostFrames > 0) {
+			clear();
+			lostFrames += info.lostFrames;
+		}
+		std::copy(inBuffer, inBuffer + valid, samples.begin());
+
+		unsigned offset = 0;
+		while (offset < valid && !doShutdown) {
+			unsigned count = std::min(valid - offset,
+					settings.hopSize - pending);
+			append(0, samples.data() + offset, count);
+			offset += count;
+			pending += count;
+			if (pending == settings.hopSize) {
+				pending = 0;
+				if (bands.back()->history.full()) {
+					dispatch();
+				}
+			}
+		}
+
+		bool endOfStream = info.endOfStream;
+		inQueue.release(inBuffer);
+		// The marker goes through the bands like a frame, so the merge
+		// thread passes it on behind the last spectrum.
+		for (unsigned index = 0; endOfStream && index < bands.size();
+				index++) {
+			SpectrumType* marker = allocate(*bands[index]->frames, true);
+			if (marker == nullptr) {
+				break;
+			}
+			ElementInfo& markerInfo = Queue<SpectrumType>::info(marker);
+			markerInfo.captureTime = captureTime;
+			markerInfo.endOfStream = true;
+			bands[index]->frames->push_back(marker);
+		}
+	}
+}
+
+/**
+ * Appends to the history of a band, and the decimated samples to the next
+ * band.
+ */
+void
+MultiResolution::
+append(unsigned index, const double* input, unsigned count)
+{
+	Band& band = *bands[index];
+	band.history.append(input, count);
+	if (!band.decimator) {
+		return;
+	}
+
+	Decimator& decimator = *band.decimator;
+	unsigned decimated = 0;
+	for (unsigned i = 0; i < count; i++) {
+		decimator.history.append(input + i, 1);
+		decimator.odd = !decimator.odd;
+		if (decimator.odd) {
+			continue;
+		}
+		const double* latest = decimator.history.latest();
+		double sum = 0;
+		for (unsigned tap = 0; tap < HalfBandTaps; tap++) {
+			sum += taps[tap] * latest[tap];
+		}
+		band.decimated[decimated++] = sum;
+	}
+	append(index + 1, band.decimated.data(), decimated);
+}
+
+void
+MultiResolution::
+clear()
+{
+	for (auto& band : bands) {
+		band->history.clear();
+		if (band->decimator) {
+			band->decimator->history.clear();
+			band->decimator->odd = false;
+		}
+	}
+	pending = 0;
+}
+
+/**
+ * Hands the frames of all bands to their workers, without waiting for the
+ * spectra: the merge thread collects them.
+ */
+void
+MultiResolution::
+dispatch()
+{
+	for (auto& band : bands) {
+		SpectrumType* frame = allocate(*band->frames, true);
+		if (frame == nullptr) {
+			return;
+		}
+		const double* history = band->history.latest();
+		for (unsigned i = 0; i < settings.fftSize; i++) {
+			frame[i] = history[i] * windowTable[i];
+		}
+		ElementInfo& info = Queue<SpectrumType>::info(frame);
+		info.captureTime = captureTime;
+		info.lostFrames = lostFrames;
+		band->frames->push_back(frame);
+	}
+	lostFrames = 0;
+}
+
+void
+MultiResolution::
+bandFunction(unsigned index)
+{
+	Band& band = *bands[index];
+
+	while (!doShutdown) {
+		SpectrumType* frame = band.frames->pop_front();
+		if (frame == nullptr) {
+			continue;
+		}
+
+		SpectrumType* power = allocate(*band.spectra, true);
+		if (power == nullptr) {
+			band.frames->release(frame);
+			break;
+		}
+
+		ElementInfo info = Queue<SpectrumType>::info(frame);
+		if (info.endOfStream) {
+			band.frames->release(frame);
+		} else {
+			// fftw_execute_dft_r2c is thread safe, the frames are aligned
+			// like the buffer the plan was made for
+			::FFTW(execute_dft_r2c)(plan, frame, band.out);
+			band.frames->release(frame);
+			computeSpectrum((const SpectrumType*) band.out, power,
+					spectrumSize, Scale::Power, windowGain);
+		}
+
+		Queue<SpectrumType>::info(power) = info;
+		band.spectra->push_back(power);
+	}
+}
+
+/**
+ * Collects the spectra of a hop, one from every band (they all get a frame
+ * per hop, so they arrive in step), and merges them.
+ */
+void
+MultiResolution::
+mergeFunction()
+{
+	while (!doShutdown) {
+		bool complete = true;
+		for (unsigned index = 0; index < bands.size(); index++) {
+			if (spectra[index] == nullptr) {
+				spectra[index] = bands[index]->spectra->pop_front();
+			}
+			complete = complete && spectra[index] != nullptr;
+		}
+		if (!complete) {
+			continue;
+		}
+
+		const ElementInfo& info = Queue<SpectrumType>::info(spectra.front());
+		// end of stream markers must not get lost
+		SpectrumType* spectrum = allocate(outQueue,
+				settings.lossless || info.endOfStream);
+		if (spectrum == nullptr) {
+			droppedFrames += info.lostFrames + 1;
+		} else {
+			if (!info.endOfStream) {
+				merge(spectrum);
+			}
+			ElementInfo& outInfo = Queue<SpectrumType>::info(spectrum);
+			outInfo = info;
+			outInfo.lostFrames += droppedFrames;
+			droppedFrames = 0;
+			outQueue.push_back(spectrum);
+		}
+
+		for (unsigned index = 0; index < bands.size(); index++) {
+			bands[index]->spectra->release(spectra[index]);
+			spectra[index] = nullptr;
+		}
+	}
+}
+
+/**
+ * Merges the power spectra of the bands into the log frequency bins and
+ * converts them to the scale.
+ */
+void
+MultiResolution::
+merge(SpectrumType* spectrum)
+{
+	for (unsigned bin = 0; bin < sources.size(); bin++) {
+		const Source& source = sources[bin];
+		const SpectrumType* power = spectra[source.band];
+		if (source.first <= source.last) {
+			merged[bin] = *std::max_element(power + source.first,
+					power + source.last + 1);
+		} else {
+			unsigned below = source.position;
+			unsigned above = std::min(below + 1, spectrumSize - 1);
+			double fraction = source.position - below;
+			merged[bin] = power[below]
+					+ fraction * (power[above] - power[below]);
+		}
+	}
+	convertPower(merged.data(), spectrum, merged.size(), settings.scale);
+}
+
+/**
+ * Waits for a free element if asked to, until shutdown.
+ */
+SpectrumType*
+MultiResolution::
+allocate(Queue<SpectrumType>& queue, bool wait)
+{
+	SpectrumType* element = queue.allocate();
+	while (element == nullptr && wait && !doShutdown) {
+		element = queue.allocate();
+	}
+	return element;
+}
+
+} // namespace
@@ -0,0 +1,202 @@
+
+#ifndef __MULTI_RESOLUTION__H
+#define __MULTI_RESOLUTION__H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fftw3.h>
+
+#include "utils/history.h"
+#include "utils/logger.h"
+#include "utils/queue.h"
+#include "fft.h"
+#include "spectrum.h"
+#include "window.h"
+#include "defs.h"
+
+namespace ockl {
+
+struct MultiResolutionSettings {
+	/**
+	 * number of octave bands, band b runs on the input decimated by 2^b
+	 */
+	unsigned bands;
+	unsigned pointsPerOctave;
+	/**
+	 * same fft size in every band, so band b has 2^b times the frequency
+	 * resolution (and the frame length) of the top band
+	 */
+	unsigned fftSize;
+	/**
+	 * in input samples, rounded up to a multiple of 2^(bands - 1)
+	 */
+	unsigned hopSize;
+	Window window;
+	Scale scale;
+	Planner planner;
+	std::string wisdomFile;
+	/**
+	 * see FftSettings
+	 */
+	bool lossless;
+};
+
+/**
+ * Parses "<bands>[:<points per octave>]" into the first two fields.
+ * \throws std::runtime_error for an invalid value
+ */
+void parseMultiResolution(const std::string& value,
+		MultiResolutionSettings& settings);
+
+/**
+ * Multi-resolution analysis: a single fft size has to trade the frequency
+ * resolution at low frequencies against the time resolution at high
+ * frequencies. Here the input is split into octave bands by a cascade of
+ * half band decimators, and every band runs an fft of the same size on its
+ * own History (like the input ring of Fft), so each octave down gets twice
+ * the frequency resolution and a twice as long frame. The power spectra of the
+ * bands are merged into one spectrum on a logarithmic frequency axis with
+ * `pointsPerOctave` bins per octave, each bin taken from the finest band
+ * which still covers its frequency.
+ *
+ * It is a mode of its own: it takes the place of the Fft on the input
+ * queue of a channel (the queues have a single consumer), and its output
+ * replaces the linear spectrum.
+ *
+ * The thread popping the input decimates and windows the frames; every band
+ * has its own worker thread for the transform, and a merge thread collects
+ * the spectra of a hop from the bands. So the bands of one hop are
+ * transformed in parallel, while the next hop is already decimated.
+ */
+class MultiResolution {
+public:
+	MultiResolution(const MultiResolutionSettings& settings,
+			unsigned samplingRate,
+			Queue<SamplingType>& inQueue,
+			Queue<SpectrumType>& outQueue,
+			const Logger& logger);
+	~MultiResolution();
+
+	/**
+	 * \return  the frequencies of the merged spectrum
+	 */
+	static FrequencyAxis axis(const MultiResolutionSettings& settings,
+			unsigned samplingRate);
+	/**
+	 * \return  the bins of the merged spectrum
+	 */
+	static unsigned binCount(const MultiResolutionSettings& settings,
+			unsigned samplingRate);
+
+	void init();
+	void start();
+	void shutdown();
+
+private:
+	static const unsigned HalfBandTaps = 64;
+	/**
+	 * part of its nyquist frequency a decimated band is used up to, the
+	 * rest is the transition band of the decimator
+	 */
+	static constexpr double PassBand = 0.8;
+
+	/**
+	 * Low pass and decimation by 2 from one band to the next.
+	 */
+	struct Decimator {
+		Decimator();
+
+		History<double> history;
+		bool odd;
+	};
+
+	struct Band {
+		explicit Band(unsigned fftSize);
+
+		History<double> history;
+		/**
+		 * feeds the next band, null for the last one
+		 */
+		std::unique_ptr<Decimator> decimator;
+		std::vector<double> decimated;
+		std::unique_ptr<Queue<SpectrumType>> frames;
+		std::unique_ptr<Queue<SpectrumType>> spectra;
+		::FFTW(complex)* out;
+		std::thread* thread;
+	};
+
+	/**
+	 * Where a bin of the merged spectrum comes from: the largest power of
+	 * the bins first..last of `band`, or if there is no bin in its range,
+	 * the power interpolated at `position`.
+	 */
+	struct Source {
+		unsigned band;
+		unsigned first;
+		unsigned last;
+		double position;
+	};
+
+	void threadFunction();
+	void bandFunction(unsigned index);
+	void mergeFunction();
+	void merge(SpectrumType* spectrum);
+	void append(unsigned index, const double* samples, unsigned count);
+	void clear();
+	void dispatch();
+	SpectrumType* allocate(Queue<SpectrumType>& queue, bool wait);
+
+	MultiResolutionSettings settings;
+	unsigned samplingRate;
+	/**
+	 * bins of the fft of one band
+	 */
+	unsigned spectrumSize;
+	/**
+	 * input samples since the last frame
+	 */
+	unsigned pending;
+
+	std::vector<double> taps;
+	std::vector<SpectrumType> windowTable;
+	double windowGain;
+	std::vector<std::unique_ptr<Band>> bands;
+	std::vector<Source> sources;
+	std::vector<SpectrumType> merged;
+	std::vector<double> samples;
+	/**
+	 * the spectra of one hop the merge thread has collected so far
+	 */
+	std::vector<SpectrumType*> spectra;
+	/**
+	 * the buffer the plan was made for, the workers transform their frames
+	 */
+	SpectrumType* in;
+	::FFTW(plan) plan;
+
+	Queue<SamplingType>& inQueue;
+	Queue<SpectrumType>& outQueue;
+	std::chrono::system_clock::time_point captureTime;
+	/**
+	 * gaps in the input, passed on with the next frames
+	 */
+	uint64_t lostFrames;
+	/**
+	 * merged spectra dropped for a full output queue
+	 */
+	uint64_t droppedFrames;
+
+	const Logger& logger;
+
+	std::thread* thread;
+	std::thread* mergeThread;
+	std::atomic<bool> doShutdown;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,314 @@
+
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "peak_finder.h"
+
+#ifdef OCKL_X86
+#include <immintrin.h>
+#endif
+
+namespace ockl {
+
+namespace {
+
+const unsigned MaxHarmonic = 10;
+
+/**
+ * The strongest local maxima so far, strongest first.
+ */
+struct TopList {
+	unsigned* bins;
+	double* levels;
+	unsigned size;
+	unsigned capacity;
+
+	double threshold() const
+	{
+		return size < capacity ? -HUGE_VAL : levels[size - 1];
+	}
+
+	void insert(unsigned bin, double level)
+	{
+		if (!(level > threshold())) {
+			return;
+		}
+		unsigned i = size < capacity ? size++ : capacity - 1;
+		while (i > 0 && levels[i - 1] < level) {
+			levels[i] = levels[i - 1];
+			bins[i] = bins[i - 1];
+			i--;
+		}
+		levels[i] = level;
+		bins[i] = bin;
+	}
+};
+
+typedef void (*ScanKernel)(const SpectrumType* spectrum, unsigned begin,
+		unsigned count, TopList& top);
+
+/*
+ * Both kernels look at the bins [begin, count - 1), a peak is higher than
+ * its left neighbour and not lower than its right one, so a flat top is
+ * reported once.
+ */
+
+void
+scalarScan(const SpectrumType* spectrum, unsigned begin, unsigned count,
+		TopList& top)
+{
+	for (unsigned i = begin; i + 1 < count; i++) {
+		if (spectrum[i] > spectrum[i - 1] && spectrum[i] >= spectrum[i + 1]) {
+			top.insert(i, spectrum[i]);
+		}
+	}
+}
+
+#if defined(OCKL_X86) && !defined(SINGLE_PRECISION)
+
+__attribute__((target("avx2")))
+void
+avx2Scan(const double* spectrum, unsigned begin, unsigned count,
+		TopList& top)
+{
+	unsigned i = begin;
+	for (; i + 4 < count; i += 4) {
+		__m256d value = _mm256_loadu_pd(spectrum + i);
+		__m256d left = _mm256_loadu_pd(spectrum + i - 1);
+		__m256d right = _mm256_loadu_pd(spectrum + i + 1);
+		__m256d mask = _mm256_and_pd(
+				_mm256_and_pd(_mm256_cmp_pd(value, left, _CMP_GT_OQ),
+						_mm256_cmp_pd(value, right, _CMP_GE_OQ)),
+				_mm256_cmp_pd(value, _mm256_set1_pd(top.threshold()),
+						_CMP_GT_OQ));
+		int bits = _mm256_movemask_pd(mask);
+		while (bits != 0) {
+			unsigned lane = __builtin_ctz(bits);
+			top.insert(i + lane, spectrum[i + lane]);
+			bits &= bits - 1;
+		}
+	}
+	scalarScan(spectrum, i, count, top);
+}
+
+#elif defined(OCKL_X86)
+
+__attribute__((target("avx2")))
+void
+avx2Scan(const float* spectrum, unsigned begin, unsigned count,
+		TopList& top)
+{
+	unsigned i = begin;
+	for (; i + 8 < count; i += 8) {
+		__m256 value = _mm256_loadu_ps(spectrum + i);
+		__m256 left = _mm256_loadu_ps(spectrum + i - 1);
+		__m256 right = _mm256_loadu_ps(spectrum + i + 1);
+		// the threshold rounded to float only lets more candidates through,
+		// insert() compares exactly
+		__m256 mask = _mm256_and_ps(
+				_mm256_and_ps(_mm256_cmp_ps(value, left, _CMP_GT_OQ),
+						_mm256_cmp_ps(value, right, _CMP_GE_OQ)),
+				_mm256_cmp_ps(value, _mm256_set1_ps(top.threshold()),
+						_CMP_GE_OQ));
+		int bits = _mm256_movemask_ps(mask);
+		while (bits != 0) {
+			unsigned lane = __builtin_ctz(bits);
+			top.insert(i + lane, spectrum[i + lane]);
+			bits &= bits - 1;
+		}
+	}
+	scalarScan(spectrum, i, count, top);
+}
+
+#endif
+
+ScanKernel
+selectScan()
+{
+#ifdef OCKL_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return avx2Scan;
+	}
+#endif
+	return scalarScan;
+}
+
+} // namespace
+
+Interpolation
+parseInterpolation(const std::string& name)
+{
+	for (Interpolation interpolation : {Interpolation::Parabolic,
+			Interpolation::Gaussian}) {
+		if (name == interpolationName(interpolation)) {
+			return interpolation;
+		}
+	}
+	throw std::runtime_error("unknown interpolation " + name);
+}
+
+std::string
+interpolationName(Interpolation interpolation)
+{
+	switch (interpolation) {
+	case Interpolation::Parabolic:
+		return "parabolic";
+	case Interpolation::Gaussian:
+		return "gaussian";
+	}
+	return "unknown";
+}
+
+PeakFinder::
+PeakFinder(const PeakSettings& settings, unsigned binCount,
+		const FrequencyAxis& axis, Scale scale)
+: count(settings.count),
+  interpolation(settings.interpolation),
+  binCount(binCount),
+  axis(axis),
+  scale(scale),
+  bins(settings.count),
+  levels(settings.count),
+  scratch(binCount)
+{
+	if (count == 0) {
+		throw std::runtime_error("at least one peak must be searched for");
+	}
+	result.peaks.reserve(count);
+	result.noiseFloor = 0;
+	result.thd = NAN;
+}
+
+const Peaks&
+PeakFinder::
+find(const SpectrumType* spectrum)
+{
+	static const ScanKernel scan = selectScan();
+
+	TopList top{bins.data(), levels.data(), 0, count};
+	scan(spectrum, 1, binCount, top);
+
+	// The median is robust against the peaks, and as the scales are
+	// monotonic the median of the values is the value of the median power.
+	std::copy(spectrum, spectrum + binCount, scratch.begin());
+	auto middle = scratch.begin() + binCount / 2;
+	std::nth_element(scratch.begin(), middle, scratch.end());
+	result.noiseFloor = *middle;
+	double noiseFloor = toDecibel(result.noiseFloor);
+
+	result.peaks.clear();
+	for (unsigned i = 0; i < top.size; i++) {
+		Peak peak = interpolate(spectrum, top.bins[i]);
+		peak.snr = toDecibel(peak.level) - noiseFloor;
+		result.peaks.push_back(peak);
+	}
+	// interpolation might have changed the order slightly
+	std::sort(result.peaks.begin(), result.peaks.end(),
+			[](const Peak& a, const Peak& b) { return a.level > b.level; });
+
+	result.thd = result.peaks.empty() ? NAN : harmonicDistortion(spectrum);
+	return result;
+}
+
+double
+PeakFinder::
+toDecibel(double value) const
+{
+	switch (scale) {
+	case Scale::Magnitude:
+		return 10 * log10(std::max(value * value, MinPower));
+	case Scale::Power:
+		return 10 * log10(std::max(value, MinPower));
+	case Scale::Decibel:
+		break;
+	}
+	return value;
+}
+
+double
+PeakFinder::
+fromDecibel(double value) const
+{
+	switch (scale) {
+	case Scale::Magnitude:
+		return pow(10.0, value / 20);
+	case Scale::Power:
+		return pow(10.0, value / 10);
+	case Scale::Decibel:
+		break;
+	}
+	return value;
+}
+
+double
+PeakFinder::
+toPower(double value) const
+{
+	switch (scale) {
+	case Scale::Magnitude:
+		return value * value;
+	case Scale::Power:
+		break;
+	case Scale::Decibel:
+		return pow(10.0, value / 10);
+	}
+	return value;
+}
+
+Peak
+PeakFinder::
+interpolate(const SpectrumType* spectrum, unsigned bin) const
+{
+	double left = spectrum[bin - 1];
+	double center = spectrum[bin];
+	double right = spectrum[bin + 1];
+	if (interpolation == Interpolation::Gaussian) {
+		left = toDecibel(left);
+		center = toDecibel(center);
+		right = toDecibel(right);
+	}
+
+	// vertex of the parabola through the three points
+	double denominator = left - 2 * center + right;
+	double offset = denominator != 0 ? 0.5 * (left - right) / denominator : 0;
+	offset = std::max(-0.5, std::min(0.5, offset));
+	double level = center - 0.25 * (left - right) * offset;
+
+	Peak peak;
+	peak.frequency = axis.frequency(bin + offset);
+	peak.level = interpolation == Interpolation::Gaussian
+			? fromDecibel(level) : level;
+	peak.snr = 0;
+	return peak;
+}
+
+/**
+ * Takes the strongest bin around every multiple of the strongest peak as
+ * its harmonic.
+ */
+double
+PeakFinder::
+harmonicDistortion(const SpectrumType* spectrum) const
+{
+	const Peak& fundamental = result.peaks.front();
+	double harmonics = 0;
+	bool found = false;
+	for (unsigned harmonic = 2; harmonic <= MaxHarmonic; harmonic++) {
+		long bin = lrint(axis.bin(harmonic * fundamental.frequency));
+		if (bin < 1 || bin + 1 >= binCount) {
+			break;
+		}
+		harmonics += toPower(std::max(spectrum[bin],
+				std::max(spectrum[bin - 1], spectrum[bin + 1])));
+		found = true;
+	}
+	if (!found) {
+		return NAN;
+	}
+	return 10 * log10(std::max(harmonics, MinPower)
+			/ std::max(toPower(fundamental.level), MinPower));
+}
+
+} // namespace
@@ -0,0 +1,113 @@
+
+#ifndef __PEAK_FINDER__H
+#define __PEAK_FINDER__H
+
+#include <string>
+#include <vector>
+
+#include "spectrum.h"
+
+namespace ockl {
+
+/**
+ * How the frequency of a peak is estimated between the bins: a parabola
+ * through the peak bin and its neighbours, either on the values as they
+ * are or on their logarithm (exact for a Gaussian shaped peak, and close
+ * to it for the main lobe of the usual windows).
+ */
+enum class Interpolation {
+	Parabolic,
+	Gaussian
+};
+
+/**
+ * \throws std::runtime_error for an unknown name
+ */
+Interpolation parseInterpolation(const std::string& name);
+
+std::string interpolationName(Interpolation interpolation);
+
+struct PeakSettings {
+	/**
+	 * number of peaks to report, 0 to disable the peak finder
+	 */
+	unsigned count;
+	Interpolation interpolation;
+};
+
+struct Peak {
+	/**
+	 * [Hz], interpolated
+	 */
+	double frequency;
+	/**
+	 * interpolated, in the scale of the spectrum
+	 */
+	double level;
+	/**
+	 * level over the noise floor [dB]
+	 */
+	double snr;
+};
+
+static_assert(sizeof(Peak) == 3 * sizeof(double), "Peak is written as is");
+
+struct Peaks {
+	/**
+	 * strongest first
+	 */
+	std::vector<Peak> peaks;
+	/**
+	 * median level of all bins, in the scale of the spectrum
+	 */
+	double noiseFloor;
+	/**
+	 * power of the harmonics of the strongest peak relative to the peak
+	 * [dB], NaN if no harmonic is below the end of the spectrum
+	 */
+	double thd;
+};
+
+/**
+ * Finds the strongest local maxima of a spectrum in one pass over the bins
+ * (AVX2 if available): a bin is only looked at closer if it is above both
+ * neighbours and above the weakest peak found so far, so the top-K list is
+ * rarely touched.
+ */
+class PeakFinder {
+public:
+	/**
+	 * \param count       number of peaks to report
+	 * \param axis        frequencies of the bins
+	 * \param scale       scale of the spectra passed to find()
+	 */
+	PeakFinder(const PeakSettings& settings, unsigned binCount,
+			const FrequencyAxis& axis, Scale scale);
+
+	/**
+	 * The result stays valid until the next call.
+	 */
+	const Peaks& find(const SpectrumType* spectrum);
+
+private:
+	double toDecibel(double value) const;
+	double fromDecibel(double value) const;
+	double toPower(double value) const;
+	Peak interpolate(const SpectrumType* spectrum, unsigned bin) const;
+	double harmonicDistortion(const SpectrumType* spectrum) const;
+
+	unsigned count;
+	Interpolation interpolation;
+	unsigned binCount;
+	FrequencyAxis axis;
+	Scale scale;
+
+	std::vector<unsigned> bins;
+	std::vector<double> levels;
+	std::vector<SpectrumType> scratch;
+	Peaks result;
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,67 @@
+
+#include <stdexcept>
+
+#include "sample_format.h"
+
+namespace ockl {
+
+SampleFormat
+parseSampleFormat(const std::string& name)
+{
+	for (SampleFormat format : {SampleFormat::S16, SampleFormat::S24,
+			SampleFormat::S32, SampleFormat::Float}) {
+		if (name == sampleFormatName(format)) {
+			return format;
+		}
+	}
+	throw std::runtime_error("unknown sample format " + name);
+}
+
+std::string
+sampleFormatName(SampleFormat format)
+{
+	switch (format) {
+	case SampleFormat::S16:
+		return "s16";
+	case SampleFormat::S24:
+		return "s24";
+	case SampleFormat::S32:
+		return "s32";
+	case SampleFormat::Float:
+		return "float";
+	}
+	return "unknown";
+}
+
+unsigned
+sampleSize(SampleFormat format)
+{
+	switch (format) {
+	case SampleFormat::S16:
+		return 2;
+	case SampleFormat::S24:
+		return 3;
+	case SampleFormat::S32:
+	case SampleFormat::Float:
+		return 4;
+	}
+	return 0;
+}
+
+SampleConverter
+sampleConverter(SampleFormat format)
+{
+	switch (format) {
+	case SampleFormat::S16:
+		return &convertSamples<SampleFormat::S16>;
+	case SampleFormat::S24:
+		return &convertSamples<SampleFormat::S24>;
+	case SampleFormat::S32:
+		return &convertSamples<SampleFormat::S32>;
+	case SampleFormat::Float:
+		return &convertSamples<SampleFormat::Float>;
+	}
+	throw std::runtime_error("unknown sample format");
+}
+
+} // namespace
@@ -0,0 +1,112 @@
+
+#ifndef __SAMPLE_FORMAT__H
+#define __SAMPLE_FORMAT__H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "defs.h"
+
+namespace ockl {
+
+/**
+ * Sample formats of capture devices and recorded files, all little endian.
+ * S24 is packed into three bytes, float samples are expected in the range
+ * [-1, 1].
+ */
+enum class SampleFormat {
+	S16,
+	S24,
+	S32,
+	Float
+};
+
+/**
+ * \throws std::runtime_error for an unknown name
+ */
+SampleFormat parseSampleFormat(const std::string& name);
+
+std::string sampleFormatName(SampleFormat format);
+
+/**
+ * \return  the size of one sample [bytes]
+ */
+unsigned sampleSize(SampleFormat format);
+
+/**
+ * Loads a single sample and scales it to SamplingType, where full scale is
+ * FullScale whatever the format. The formats wider than 16 bit keep their
+ * extra resolution as the fraction.
+ */
+template <SampleFormat format>
+struct SampleTraits;
+
+template <>
+struct SampleTraits<SampleFormat::S16> {
+	static SamplingType load(const uint8_t* source)
+	{
+		int16_t value;
+		memcpy(&value, source, sizeof(value));
+		return value;
+	}
+};
+
+template <>
+struct SampleTraits<SampleFormat::S24> {
+	static SamplingType load(const uint8_t* source)
+	{
+		// into the upper three bytes, so the sign comes along
+		int32_t value = (int32_t) ((uint32_t) source[0] << 8
+				| (uint32_t) source[1] << 16 | (uint32_t) source[2] << 24);
+		return value * (float) (FullScale / 2147483648.0);
+	}
+};
+
+template <>
+struct SampleTraits<SampleFormat::S32> {
+	static SamplingType load(const uint8_t* source)
+	{
+		int32_t value;
+		memcpy(&value, source, sizeof(value));
+		return value * (float) (FullScale / 2147483648.0);
+	}
+};
+
+template <>
+struct SampleTraits<SampleFormat::Float> {
+	static SamplingType load(const uint8_t* source)
+	{
+		float value;
+		memcpy(&value, source, sizeof(value));
+		return value * (float) FullScale;
+	}
+};
+
+/**
+ * Converts `count` samples, `step` bytes apart (e.g. one channel of
+ * interleaved frames). There is one instance per format, so the loop body
+ * is branch free and the format is switched once per call.
+ */
+template <SampleFormat format>
+void
+convertSamples(const uint8_t* __restrict source, unsigned step,
+		SamplingType* __restrict destination, unsigned count)
+{
+	for (unsigned i = 0; i < count; i++) {
+		destination[i] = SampleTraits<format>::load(source);
+		source += step;
+	}
+}
+
+typedef void (*SampleConverter)(const uint8_t* source, unsigned step,
+		SamplingType* destination, unsigned count);
+
+/**
+ * \return  convertSamples() for `format`
+ */
+SampleConverter sampleConverter(SampleFormat format);
+
+} // namespace
+
+#endif
@@ -0,0 +1,607 @@
+
+#include <math.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "spectrum.h"
+
+#ifdef OCKL_X86
+#include <immintrin.h>
+#endif
+
+namespace ockl {
+
+namespace {
+
+const double DecibelPerLn = 10.0 / M_LN10;
+
+void
+scalarKernel(const SpectrumType* bins, SpectrumType* spectrum,
+		unsigned count, Scale scale, double gain)
+{
+	double factor = 1.0 / (gain * gain);
+	for (unsigned i = 0; i < count; i++) {
+		double power = bins[2 * i] * bins[2 * i]
+				+ bins[2 * i + 1] * bins[2 * i + 1];
+		switch (scale) {
+		case Scale::Magnitude:
+			spectrum[i] = sqrt(power * factor);
+			break;
+		case Scale::Power:
+			spectrum[i] = power * factor;
+			break;
+		case Scale::Decibel:
+			spectrum[i] = 10 * log10(std::max(power * factor, MinPower));
+			break;
+		}
+	}
+}
+
+void
+scalarPowerKernel(const SpectrumType* power, SpectrumType* spectrum,
+		unsigned count, Scale scale)
+{
+	for (unsigned i = 0; i < count; i++) {
+		switch (scale) {
+		case Scale::Magnitude:
+			spectrum[i] = sqrt(power[i]);
+			break;
+		case Scale::Power:
+			spectrum[i] = power[i];
+			break;
+		case Scale::Decibel:
+			spectrum[i] = 10 * log10(std::max<double>(power[i], MinPower));
+			break;
+		}
+	}
+}
+
+#if defined(OCKL_X86) && !defined(SINGLE_PRECISION)
+
+/*
+ * Natural logarithm of positive, normal doubles: x = m * 2^e with m in
+ * [sqrt(2)/2, sqrt(2)), ln(m) = 2 atanh(t) with t = (m - 1) / (m + 1) and
+ * |t| < 0.172, so five terms of the atanh series are accurate to 1e-9.
+ * Both versions are the same algorithm, once with 2 and once with 4 lanes.
+ */
+
+inline __m128d
+vectorLog(__m128d x)
+{
+	const __m128i mantissaMask = _mm_set1_epi64x(0x000fffffffffffffll);
+	const __m128i one = _mm_set1_epi64x(0x3ff0000000000000ll);
+	const __m128i twoPow52 = _mm_set1_epi64x(0x4330000000000000ll);
+
+	__m128i bits = _mm_castpd_si128(x);
+	__m128d exponent = _mm_sub_pd(
+			_mm_castsi128_pd(_mm_or_si128(_mm_srli_epi64(bits, 52), twoPow52)),
+			_mm_set1_pd(4503599627370496.0 + 1023.0));
+	__m128d m = _mm_castsi128_pd(
+			_mm_or_si128(_mm_and_si128(bits, mantissaMask), one));
+
+	__m128d large = _mm_cmpgt_pd(m, _mm_set1_pd(M_SQRT2));
+	m = _mm_sub_pd(m, _mm_and_pd(large, _mm_mul_pd(m, _mm_set1_pd(0.5))));
+	exponent = _mm_add_pd(exponent, _mm_and_pd(large, _mm_set1_pd(1.0)));
+
+	__m128d t = _mm_div_pd(_mm_sub_pd(m, _mm_set1_pd(1.0)),
+			_mm_add_pd(m, _mm_set1_pd(1.0)));
+	__m128d t2 = _mm_mul_pd(t, t);
+	__m128d series = _mm_set1_pd(1.0 / 9);
+	series = _mm_add_pd(_mm_mul_pd(series, t2), _mm_set1_pd(1.0 / 7));
+	series = _mm_add_pd(_mm_mul_pd(series, t2), _mm_set1_pd(1.0 / 5));
+	series = _mm_add_pd(_mm_mul_pd(series, t2), _mm_set1_pd(1.0 / 3));
+	series = _mm_add_pd(_mm_mul_pd(series, t2), _mm_set1_pd(1.0));
+
+	return _mm_add_pd(_mm_mul_pd(exponent, _mm_set1_pd(M_LN2)),
+			_mm_mul_pd(_mm_mul_pd(series, t), _mm_set1_pd(2.0)));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256d
+vectorLog(__m256d x)
+{
+	const __m256i mantissaMask = _mm256_set1_epi64x(0x000fffffffffffffll);
+	const __m256i one = _mm256_set1_epi64x(0x3ff0000000000000ll);
+	const __m256i twoPow52 = _mm256_set1_epi64x(0x4330000000000000ll);
+
+	__m256i bits = _mm256_castpd_si256(x);
+	__m256d exponent = _mm256_sub_pd(
+			_mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52),
+					twoPow52)),
+			_mm256_set1_pd(4503599627370496.0 + 1023.0));
+	__m256d m = _mm256_castsi256_pd(
+			_mm256_or_si256(_mm256_and_si256(bits, mantissaMask), one));
+
+	__m256d large = _mm256_cmp_pd(m, _mm256_set1_pd(M_SQRT2), _CMP_GT_OQ);
+	m = _mm256_blendv_pd(m, _mm256_mul_pd(m, _mm256_set1_pd(0.5)), large);
+	exponent = _mm256_add_pd(exponent,
+			_mm256_and_pd(large, _mm256_set1_pd(1.0)));
+
+	__m256d t = _mm256_div_pd(_mm256_sub_pd(m, _mm256_set1_pd(1.0)),
+			_mm256_add_pd(m, _mm256_set1_pd(1.0)));
+	__m256d t2 = _mm256_mul_pd(t, t);
+	__m256d series = _mm256_set1_pd(1.0 / 9);
+	series = _mm256_fmadd_pd(series, t2, _mm256_set1_pd(1.0 / 7));
+	series = _mm256_fmadd_pd(series, t2, _mm256_set1_pd(1.0 / 5));
+	series = _mm256_fmadd_pd(series, t2, _mm256_set1_pd(1.0 / 3));
+	series = _mm256_fmadd_pd(series, t2, _mm256_set1_pd(1.0));
+
+	return _mm256_fmadd_pd(exponent, _mm256_set1_pd(M_LN2),
+			_mm256_mul_pd(_mm256_mul_pd(series, t), _mm256_set1_pd(2.0)));
+}
+
+/*
+ * The scale is switched outside of the loops, so that every loop body is
+ * branch free.
+ */
+
+void
+sse2Kernel(const double* bins, double* spectrum, unsigned count,
+		Scale scale, double gain)
+{
+	const __m128d factor = _mm_set1_pd(1.0 / (gain * gain));
+	unsigned vectorCount = count & ~1u;
+
+	// two complex bins per iteration: [re0 im0] [re1 im1] -> [p0 p1]
+	auto power = [&](unsigned i) {
+		__m128d a = _mm_loadu_pd(bins + 2 * i);
+		__m128d b = _mm_loadu_pd(bins + 2 * i + 2);
+		a = _mm_mul_pd(a, a);
+		b = _mm_mul_pd(b, b);
+		return _mm_mul_pd(_mm_add_pd(_mm_unpacklo_pd(a, b),
+				_mm_unpackhi_pd(a, b)), factor);
+	};
+
+	switch (scale) {
+	case Scale::Magnitude:
+		for (unsigned i = 0; i < vectorCount; i += 2) {
+			_mm_storeu_pd(spectrum + i, _mm_sqrt_pd(power(i)));
+		}
+		break;
+	case Scale::Power:
+		for (unsigned i = 0; i < vectorCount; i += 2) {
+			_mm_storeu_pd(spectrum + i, power(i));
+		}
+		break;
+	case Scale::Decibel:
+		for (unsigned i = 0; i < vectorCount; i += 2) {
+			__m128d p = _mm_max_pd(power(i), _mm_set1_pd(MinPower));
+			_mm_storeu_pd(spectrum + i,
+					_mm_mul_pd(vectorLog(p), _mm_set1_pd(DecibelPerLn)));
+		}
+		break;
+	}
+
+	scalarKernel(bins + 2 * vectorCount, spectrum + vectorCount,
+			count - vectorCount, scale, gain);
+}
+
+__attribute__((target("avx2,fma")))
+void
+avx2Kernel(const double* bins, double* spectrum, unsigned count,
+		Scale scale, double gain)
+{
+	const __m256d factor = _mm256_set1_pd(1.0 / (gain * gain));
+	unsigned vectorCount = count & ~3u;
+
+	// four complex bins per iteration, hadd gives [p0 p2 p1 p3]
+	auto power = [&](unsigned i) __attribute__((target("avx2,fma"))) {
+		__m256d a = _mm256_loadu_pd(bins + 2 * i);
+		__m256d b = _mm256_loadu_pd(bins + 2 * i + 4);
+		__m256d sum = _mm256_hadd_pd(_mm256_mul_pd(a, a), _mm256_mul_pd(b, b));
+		return _mm256_mul_pd(_mm256_permute4x64_pd(sum, 0xd8), factor);
+	};
+
+	switch (scale) {
+	case Scale::Magnitude:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			_mm256_storeu_pd(spectrum + i, _mm256_sqrt_pd(power(i)));
+		}
+		break;
+	case Scale::Power:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			_mm256_storeu_pd(spectrum + i, power(i));
+		}
+		break;
+	case Scale::Decibel:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			__m256d p = _mm256_max_pd(power(i), _mm256_set1_pd(MinPower));
+			_mm256_storeu_pd(spectrum + i,
+					_mm256_mul_pd(vectorLog(p), _mm256_set1_pd(DecibelPerLn)));
+		}
+		break;
+	}
+
+	scalarKernel(bins + 2 * vectorCount, spectrum + vectorCount,
+			count - vectorCount, scale, gain);
+}
+
+void
+sse2PowerKernel(const double* power, double* spectrum, unsigned count,
+		Scale scale)
+{
+	unsigned vectorCount = count & ~1u;
+
+	switch (scale) {
+	case Scale::Magnitude:
+		for (unsigned i = 0; i < vectorCount; i += 2) {
+			_mm_storeu_pd(spectrum + i, _mm_sqrt_pd(_mm_loadu_pd(power + i)));
+		}
+		break;
+	case Scale::Power:
+		if (power != spectrum) {
+			std::copy(power, power + vectorCount, spectrum);
+		}
+		break;
+	case Scale::Decibel:
+		for (unsigned i = 0; i < vectorCount; i += 2) {
+			__m128d p = _mm_max_pd(_mm_loadu_pd(power + i),
+					_mm_set1_pd(MinPower));
+			_mm_storeu_pd(spectrum + i,
+					_mm_mul_pd(vectorLog(p), _mm_set1_pd(DecibelPerLn)));
+		}
+		break;
+	}
+
+	scalarPowerKernel(power + vectorCount, spectrum + vectorCount,
+			count - vectorCount, scale);
+}
+
+__attribute__((target("avx2,fma")))
+void
+avx2PowerKernel(const double* power, double* spectrum, unsigned count,
+		Scale scale)
+{
+	unsigned vectorCount = count & ~3u;
+
+	switch (scale) {
+	case Scale::Magnitude:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			_mm256_storeu_pd(spectrum + i,
+					_mm256_sqrt_pd(_mm256_loadu_pd(power + i)));
+		}
+		break;
+	case Scale::Power:
+		if (power != spectrum) {
+			std::copy(power, power + vectorCount, spectrum);
+		}
+		break;
+	case Scale::Decibel:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			__m256d p = _mm256_max_pd(_mm256_loadu_pd(power + i),
+					_mm256_set1_pd(MinPower));
+			_mm256_storeu_pd(spectrum + i,
+					_mm256_mul_pd(vectorLog(p), _mm256_set1_pd(DecibelPerLn)));
+		}
+		break;
+	}
+
+	scalarPowerKernel(power + vectorCount, spectrum + vectorCount,
+			count - vectorCount, scale);
+}
+
+#elif defined(OCKL_X86)
+
+/*
+ * The same for floats: the exponent is taken as an int32 and the series
+ * needs one term less, |t| < 0.172 makes four terms accurate to 3e-8. With
+ * twice the lanes per register the kernels handle 4 (SSE2) and 8 (AVX2)
+ * bins per iteration.
+ */
+
+inline __m128
+vectorLog(__m128 x)
+{
+	const __m128i mantissaMask = _mm_set1_epi32(0x007fffff);
+	const __m128i one = _mm_set1_epi32(0x3f800000);
+
+	__m128i bits = _mm_castps_si128(x);
+	__m128 exponent = _mm_cvtepi32_ps(
+			_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+	__m128 m = _mm_castsi128_ps(
+			_mm_or_si128(_mm_and_si128(bits, mantissaMask), one));
+
+	__m128 large = _mm_cmpgt_ps(m, _mm_set1_ps(M_SQRT2));
+	m = _mm_sub_ps(m, _mm_and_ps(large, _mm_mul_ps(m, _mm_set1_ps(0.5f))));
+	exponent = _mm_add_ps(exponent, _mm_and_ps(large, _mm_set1_ps(1.0f)));
+
+	__m128 t = _mm_div_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)),
+			_mm_add_ps(m, _mm_set1_ps(1.0f)));
+	__m128 t2 = _mm_mul_ps(t, t);
+	__m128 series = _mm_set1_ps(1.0f / 7);
+	series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f / 5));
+	series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f / 3));
+	series = _mm_add_ps(_mm_mul_ps(series, t2), _mm_set1_ps(1.0f));
+
+	return _mm_add_ps(_mm_mul_ps(exponent, _mm_set1_ps(M_LN2)),
+			_mm_mul_ps(_mm_mul_ps(series, t), _mm_set1_ps(2.0f)));
+}
+
+__attribute__((target("avx2,fma")))
+inline __m256
+vectorLog(__m256 x)
+{
+	const __m256i mantissaMask = _mm256_set1_epi32(0x007fffff);
+	const __m256i one = _mm256_set1_epi32(0x3f800000);
+
+	__m256i bits = _mm256_castps_si256(x);
+	__m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+			_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+	__m256 m = _mm256_castsi256_ps(
+			_mm256_or_si256(_mm256_and_si256(bits, mantissaMask), one));
+
+	__m256 large = _mm256_cmp_ps(m, _mm256_set1_ps(M_SQRT2), _CMP_GT_OQ);
+	m = _mm256_blendv_ps(m, _mm256_mul_ps(m, _mm256_set1_ps(0.5f)), large);
+	exponent = _mm256_add_ps(exponent,
+			_mm256_and_ps(large, _mm256_set1_ps(1.0f)));
+
+	__m256 t = _mm256_div_ps(_mm256_sub_ps(m, _mm256_set1_ps(1.0f)),
+			_mm256_add_ps(m, _mm256_set1_ps(1.0f)));
+	__m256 t2 = _mm256_mul_ps(t, t);
+	__m256 series = _mm256_set1_ps(1.0f / 7);
+	series = _mm256_fmadd_ps(series, t2, _mm256_set1_ps(1.0f / 5));
+	series = _mm256_fmadd_ps(series, t2, _mm256_set1_ps(1.0f / 3));
+	series = _mm256_fmadd_ps(series, t2, _mm256_set1_ps(1.0f));
+
+	return _mm256_fmadd_ps(exponent, _mm256_set1_ps(M_LN2),
+			_mm256_mul_ps(_mm256_mul_ps(series, t), _mm256_set1_ps(2.0f)));
+}
+
+void
+sse2Kernel(const float* bins, float* spectrum, unsigned count,
+		Scale scale, double gain)
+{
+	const __m128 factor = _mm_set1_ps(1.0 / (gain * gain));
+	unsigned vectorCount = count & ~3u;
+
+	// four complex bins per iteration: [re0 im0 re1 im1] [re2 im2 re3 im3]
+	// -> [p0 p1 p2 p3]
+	auto power = [&](unsigned i) {
+		__m128 a = _mm_loadu_ps(bins + 2 * i);
+		__m128 b = _mm_loadu_ps(bins + 2 * i + 4);
+		a = _mm_mul_ps(a, a);
+		b = _mm_mul_ps(b, b);
+		return _mm_mul_ps(_mm_add_ps(
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+				_mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), factor);
+	};
+
+	switch (scale) {
+	case Scale::Magnitude:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			_mm_storeu_ps(spectrum + i, _mm_sqrt_ps(power(i)));
+		}
+		break;
+	case Scale::Power:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			_mm_storeu_ps(spectrum + i, power(i));
+		}
+		break;
+	case Scale::Decibel:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			__m128 p = _mm_max_ps(power(i), _mm_set1_ps(MinPower));
+			_mm_storeu_ps(spectrum + i,
+					_mm_mul_ps(vectorLog(p), _mm_set1_ps(DecibelPerLn)));
+		}
+		break;
+	}
+
+	scalarKernel(bins + 2 * vectorCount, spectrum + vectorCount,
+			count - vectorCount, scale, gain);
+}
+
+__attribute__((target("avx2,fma")))
+void
+avx2Kernel(const float* bins, float* spectrum, unsigned count,
+		Scale scale, double gain)
+{
+	const __m256 factor = _mm256_set1_ps(1.0 / (gain * gain));
+	unsigned vectorCount = count & ~7u;
+
+	// eight complex bins per iteration, hadd gives [p0 p1 p4 p5 p2 p3 p6 p7],
+	// which is sorted in pairs
+	auto power = [&](unsigned i) __attribute__((target("avx2,fma"))) {
+		__m256 a = _mm256_loadu_ps(bins + 2 * i);
+		__m256 b = _mm256_loadu_ps(bins + 2 * i + 8);
+		__m256 sum = _mm256_hadd_ps(_mm256_mul_ps(a, a), _mm256_mul_ps(b, b));
+		return _mm256_mul_ps(_mm256_castpd_ps(_mm256_permute4x64_pd(
+				_mm256_castps_pd(sum), 0xd8)), factor);
+	};
+
+	switch (scale) {
+	case Scale::Magnitude:
+		for (unsigned i = 0; i < vectorCount; i += 8) {
+			_mm256_storeu_ps(spectrum + i, _mm256_sqrt_ps(power(i)));
+		}
+		break;
+	case Scale::Power:
+		for (unsigned i = 0; i < vectorCount; i += 8) {
+			_mm256_storeu_ps(spectrum + i, power(i));
+		}
+		break;
+	case Scale::Decibel:
+		for (unsigned i = 0; i < vectorCount; i += 8) {
+			__m256 p = _mm256_max_ps(power(i), _mm256_set1_ps(MinPower));
+			_mm256_storeu_ps(spectrum + i,
+					_mm256_mul_ps(vectorLog(p), _mm256_set1_ps(DecibelPerLn)));
+		}
+		break;
+	}
+
+	scalarKernel(bins + 2 * vectorCount, spectrum + vectorCount,
+			count - vectorCount, scale, gain);
+}
+
+void
+sse2PowerKernel(const float* power, float* spectrum, unsigned count,
+		Scale scale)
+{
+	unsigned vectorCount = count & ~3u;
+
+	switch (scale) {
+	case Scale::Magnitude:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			_mm_storeu_ps(spectrum + i, _mm_sqrt_ps(_mm_loadu_ps(power + i)));
+		}
+		break;
+	case Scale::Power:
+		if (power != spectrum) {
+			std::copy(power, power + vectorCount, spectrum);
+		}
+		break;
+	case Scale::Decibel:
+		for (unsigned i = 0; i < vectorCount; i += 4) {
+			__m128 p = _mm_max_ps(_mm_loadu_ps(power + i),
+					_mm_set1_ps(MinPower));
+			_mm_storeu_ps(spectrum + i,
+					_mm_mul_ps(vectorLog(p), _mm_set1_ps(DecibelPerLn)));
+		}
+		break;
+	}
+
+	scalarPowerKernel(power + vectorCount, spectrum + vectorCount,
+			count - vectorCount, scale);
+}
+
+__attribute__((target("avx2,fma")))
+void
+avx2PowerKernel(const float* power, float* spectrum, unsigned count,
+		Scale scale)
+{
+	unsigned vectorCount = count & ~7u;
+
+	switch (scale) {
+	case Scale::Magnitude:
+		for (unsigned i = 0; i < vectorCount; i += 8) {
+			_mm256_storeu_ps(spectrum + i,
+					_mm256_sqrt_ps(_mm256_loadu_ps(power + i)));
+		}
+		break;
+	case Scale::Power:
+		if (power != spectrum) {
+			std::copy(power, power + vectorCount, spectrum);
+		}
+		break;
+	case Scale::Decibel:
+		for (unsigned i = 0; i < vectorCount; i += 8) {
+			__m256 p = _mm256_max_ps(_mm256_loadu_ps(power + i),
+					_mm256_set1_ps(MinPower));
+			_mm256_storeu_ps(spectrum + i,
+					_mm256_mul_ps(vectorLog(p), _mm256_set1_ps(DecibelPerLn)));
+		}
+		break;
+	}
+
+	scalarPowerKernel(power + vectorCount, spectrum + vectorCount,
+			count - vectorCount, scale);
+}
+
+#endif
+
+PowerKernel
+selectPowerKernel()
+{
+#ifdef OCKL_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return avx2PowerKernel;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return sse2PowerKernel;
+	}
+#endif
+	return scalarPowerKernel;
+}
+
+SpectrumKernel
+selectKernel()
+{
+#ifdef OCKL_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return avx2Kernel;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return sse2Kernel;
+	}
+#endif
+	return scalarKernel;
+}
+
+} // namespace
+
+Scale
+parseScale(const std::string& name)
+{
+	for (Scale scale : {Scale::Magnitude, Scale::Power, Scale::Decibel}) {
+		if (name == scaleName(scale)) {
+			return scale;
+		}
+	}
+	throw std::runtime_error("unknown scale " + name);
+}
+
+std::string
+scaleName(Scale scale)
+{
+	switch (scale) {
+	case Scale::Magnitude:
+		return "magnitude";
+	case Scale::Power:
+		return "power";
+	case Scale::Decibel:
+		return "db";
+	}
+	return "unknown";
+}
+
+double
+FrequencyAxis::
+frequency(double bin) const
+{
+	return logarithmic ? start * pow(step, bin) : start + bin * step;
+}
+
+double
+FrequencyAxis::
+bin(double frequency) const
+{
+	if (!logarithmic) {
+		return (frequency - start) / step;
+	}
+	return frequency > 0 ? log(frequency / start) / log(step) : -INFINITY;
+}
+
+void
+computeSpectrum(const SpectrumType* bins, SpectrumType* spectrum,
+		unsigned count, Scale scale, double gain)
+{
+	static const SpectrumKernel kernel = selectKernel();
+	kernel(bins, spectrum, count, scale, gain);
+}
+
+void
+convertPower(const SpectrumType* power, SpectrumType* spectrum,
+		unsigned count, Scale scale)
+{
+	static const PowerKernel kernel = selectPowerKernel();
+	kernel(power, spectrum, count, scale);
+}
+
+std::vector<NamedSpectrumKernel>
+availableSpectrumKernels()
+{
+	std::vector<NamedSpectrumKernel> kernels{{"scalar", scalarKernel}};
+#ifdef OCKL_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2")) {
+		kernels.push_back({"sse2", sse2Kernel});
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		kernels.push_back({"avx2", avx2Kernel});
+	}
+#endif
+	return kernels;
+}
+
+} // namespace
@@ -0,0 +1,100 @@
+
+#ifndef __SPECTRUM__H
+#define __SPECTRUM__H
+
+#include <string>
+#include <vector>
+
+#include "defs.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define OCKL_X86
+#endif
+
+namespace ockl {
+
+/**
+ * Floor of the power before taking the logarithm, -300 dB instead of
+ * -inf for an empty bin.
+ */
+const double MinPower = 1e-30;
+
+/**
+ * Unit of the values in the spectra handed to the ui.
+ */
+enum class Scale {
+	Magnitude,
+	Power,
+	Decibel
+};
+
+/**
+ * \throws std::runtime_error for an unknown name
+ */
+Scale parseScale(const std::string& name);
+
+std::string scaleName(Scale scale);
+
+/**
+ * Frequencies of the bins of a spectrum: start + bin * step [Hz] for the
+ * linear fft bins, start * step^bin for the logarithmic bins of
+ * MultiResolution.
+ */
+struct FrequencyAxis {
+	double start;
+	double step;
+	bool logarithmic;
+
+	/**
+	 * \param bin  may be fractional
+	 */
+	double frequency(double bin) const;
+	/**
+	 * \return  the fractional bin of `frequency`, -inf for frequencies
+	 *          <= 0 on a logarithmic axis
+	 */
+	double bin(double frequency) const;
+};
+
+/**
+ * Converts `count` complex fft bins (interleaved real and imaginary parts,
+ * as in fftw_complex) to magnitude |X| / gain, power |X|^2 / gain^2 or
+ * 10 * log10 of the power. The power is floored at -300 dB.
+ */
+typedef void (*SpectrumKernel)(const SpectrumType* bins,
+		SpectrumType* spectrum, unsigned count, Scale scale, double gain);
+
+/**
+ * Runs the fastest kernel the cpu supports (AVX2, SSE2 or plain C++),
+ * selected once on the first call. The vector kernels exist for both
+ * precisions of SpectrumType, with twice the lanes for float.
+ */
+void computeSpectrum(const SpectrumType* bins, SpectrumType* spectrum,
+		unsigned count, Scale scale, double gain);
+
+/**
+ * Converts power values, as computed with Scale::Power, to `scale`. The
+ * conversion may be done in place.
+ */
+typedef void (*PowerKernel)(const SpectrumType* power,
+		SpectrumType* spectrum, unsigned count, Scale scale);
+
+/**
+ * Like computeSpectrum, the fastest kernel the cpu supports.
+ */
+void convertPower(const SpectrumType* power, SpectrumType* spectrum,
+		unsigned count, Scale scale);
+
+struct NamedSpectrumKernel {
+	std::string name;
+	SpectrumKernel kernel;
+};
+
+/**
+ * All kernels usable on this cpu, slowest first. For benchmarks.
+ */
+std::vector<NamedSpectrumKernel> availableSpectrumKernels();
+
+} // namespace
+
+#endif
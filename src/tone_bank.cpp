@@ -0,0 +1,344 @@
+
+#include <math.h>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "tone_bank.h"
+
+namespace ockl {
+
+std::vector<double>
+parseTones(const std::string& value)
+{
+	std::vector<double> frequencies;
+	std::istringstream iss(value);
+	std::string item;
+	while (std::getline(iss, item, ',')) {
+		frequencies.push_back(std::stod(item));
+	}
+	if (frequencies.empty()) {
+		throw std::runtime_error("no tone frequencies given");
+	}
+	return frequencies;
+}
+
+SlidingDft::
+SlidingDft(const std::vector<double>& frequencies, unsigned samplingRate,
+		unsigned windowSize, Window window)
+: toneCount(frequencies.size()),
+  windowSize(windowSize),
+  binsPerTone(2 * windowCoefficients(window).size() - 1),
+  binCount(toneCount * binsPerTone),
+  gain(windowCoefficients(window).front() * windowSize),
+  real(binCount),
+  imaginary(binCount),
+  stepReal(binCount),
+  stepImaginary(binCount),
+  windowStepReal(binCount),
+  windowStepImaginary(binCount),
+  coefficients(binCount),
+  combined(2 * toneCount),
+  samples(windowSize),
+  position(0),
+  appended(0),
+  untilRefresh((uint64_t) RefreshWindows * windowSize)
+{
+	if (windowSize == 0) {
+		throw std::runtime_error("window size must not be 0");
+	}
+
+	std::vector<double> a = windowCoefficients(window);
+	int m = a.size() - 1;
+	for (unsigned tone = 0; tone < toneCount; tone++) {
+		double frequency = frequencies[tone];
+		if (frequency < 0 || frequency > samplingRate / 2.0) {
+			std::ostringstream oss;
+			oss << "tone " << frequency << " [Hz] beyond nyquist";
+			throw std::runtime_error(oss.str());
+		}
+		// in cycles per sample, and the whole cycles per window dropped
+		// before going to radians, so long windows keep their precision
+		double cycles = frequency / samplingRate;
+		double windowCycles = fmod(cycles * windowSize, 1.0);
+
+		for (int k = -m; k <= m; k++) {
+			unsigned bin = tone * binsPerTone + k + m;
+			std::complex<double> step = std::polar(1.0,
+					2 * M_PI * (cycles + (double) k / windowSize));
+			stepReal[bin] = step.real();
+			stepImaginary[bin] = step.imag();
+			// the bins one fft bin apart differ by whole cycles per window
+			std::complex<double> windowStep = std::polar(1.0,
+					2 * M_PI * windowCycles);
+			windowStepReal[bin] = windowStep.real();
+			windowStepImaginary[bin] = windowStep.imag();
+
+			// The window runs from the oldest sample, the bins count the
+			// age from the newest: cos(k x) with x for age i is
+			// cos(2 pi k (i + 1) / windowSize).
+			int sign = (k & 1) ? -1 : 1;
+			coefficients[bin] = k == 0 ? std::complex<double>(a[0])
+					: sign * a[std::abs(k)] / 2 * std::polar(1.0,
+							2 * M_PI * k / windowSize);
+		}
+	}
+}
+
+void
+SlidingDft::
+append(const SamplingType* input, unsigned count)
+{
+	while (count > 0) {
+		unsigned chunk = (unsigned) std::min<uint64_t>(count, untilRefresh);
+		update(input, chunk);
+		input += chunk;
+		count -= chunk;
+		appended += chunk;
+		untilRefresh -= chunk;
+		if (untilRefresh == 0) {
+			refresh();
+			untilRefresh = (uint64_t) RefreshWindows * windowSize;
+		}
+	}
+}
+
+/**
+ * The inner loop runs over the bins, which are independent of each other,
+ * so the compiler vectorizes it.
+ */
+void
+SlidingDft::
+update(const SamplingType* input, unsigned count)
+{
+	double* __restrict re = real.data();
+	double* __restrict im = imaginary.data();
+	const double* __restrict wr = stepReal.data();
+	const double* __restrict wi = stepImaginary.data();
+	const double* __restrict nr = windowStepReal.data();
+	const double* __restrict ni = windowStepImaginary.data();
+	unsigned bins = binCount;
+
+	for (unsigned n = 0; n < count; n++) {
+		double sample = input[n];
+		double oldest = samples[position];
+		samples[position] = sample;
+		if (++position == windowSize) {
+			position = 0;
+		}
+
+		for (unsigned bin = 0; bin < bins; bin++) {
+			double r = sample - nr[bin] * oldest
+					+ wr[bin] * re[bin] - wi[bin] * im[bin];
+			double i = -ni[bin] * oldest
+					+ wr[bin] * im[bin] + wi[bin] * re[bin];
+			re[bin] = r;
+			im[bin] = i;
+		}
+	}
+}
+
+/**
+ * Recomputes every bin from the stored window, newest sample first.
+ */
+void
+SlidingDft::
+refresh()
+{
+	for (unsigned bin = 0; bin < binCount; bin++) {
+		std::complex<double> step(stepReal[bin], stepImaginary[bin]);
+		std::complex<double> power(1.0);
+		std::complex<double> sum;
+		unsigned index = position;
+		for (unsigned i = 0; i < windowSize; i++) {
+			index = index == 0 ? windowSize - 1 : index - 1;
+			sum += samples[index] * power;
+			power *= step;
+		}
+		real[bin] = sum.real();
+		imaginary[bin] = sum.imag();
+	}
+}
+
+bool
+SlidingDft::
+full() const
+{
+	return appended >= windowSize;
+}
+
+void
+SlidingDft::
+reset()
+{
+	std::fill(real.begin(), real.end(), 0.0);
+	std::fill(imaginary.begin(), imaginary.end(), 0.0);
+	std::fill(samples.begin(), samples.end(), 0.0);
+	position = 0;
+	appended = 0;
+	untilRefresh = (uint64_t) RefreshWindows * windowSize;
+}
+
+void
+SlidingDft::
+levels(SpectrumType* values, Scale scale)
+{
+	for (unsigned tone = 0; tone < toneCount; tone++) {
+		std::complex<double> sum;
+		for (unsigned bin = tone * binsPerTone;
+				bin < (tone + 1) * binsPerTone; bin++) {
+			sum += coefficients[bin]
+					* std::complex<double>(real[bin], imaginary[bin]);
+		}
+		combined[2 * tone] = sum.real();
+		combined[2 * tone + 1] = sum.imag();
+	}
+	computeSpectrum(combined.data(), values, toneCount, scale, gain);
+}
+
+ToneBank::
+ToneBank(const ToneSettings& settings,
+		unsigned samplingRate,
+		Queue<SamplingType>& inQueue,
+		Queue<SpectrumType>& outQueue,
+		const Logger& logger)
+: settings(settings),
+  samplingRate(samplingRate),
+  countdown(settings.hopSize),
+  lostFrames(0),
+  inQueue(inQueue),
+  outQueue(outQueue),
+  logger(logger),
+  thread(nullptr),
+  doShutdown(false)
+{
+}
+
+ToneBank::
+~ToneBank()
+{
+	if (thread != nullptr) {
+		doShutdown = true;
+		thread->join();
+		delete thread;
+		thread = nullptr;
+	}
+}
+
+void
+ToneBank::
+init()
+{
+	if (dft) {
+		throw std::runtime_error("tone bank already initialized");
+	}
+	if (settings.hopSize == 0 || settings.hopSize > settings.windowSize) {
+		throw std::runtime_error("hop size must be in the range [1, window size]");
+	}
+	if (outQueue.getElementSize() != settings.frequencies.size()) {
+		throw std::runtime_error("tone bank needs one output value per tone");
+	}
+	dft.reset(new SlidingDft(settings.frequencies, samplingRate,
+			settings.windowSize, settings.window));
+}
+
+void
+ToneBank::
+start()
+{
+	if (!dft) {
+		throw std::runtime_error("tone bank not initialized");
+	}
+
+	std::ostringstream tones;
+	for (double frequency : settings.frequencies) {
+		tones << (tones.tellp() > 0 ? ", " : "") << frequency;
+	}
+	LOGGER_INFO("tones: " << tones.str() << " [Hz], window: "
+			<< windowName(settings.window) << ", hop size: "
+			<< settings.hopSize << " [frames]");
+
+	thread = new std::thread(&ToneBank::threadFunction, this);
+	pthread_setname_np(thread->native_handle(), "tones");
+}
+
+void
+ToneBank::
+shutdown()
+{
+	doShutdown = true;
+}
+
+void
+ToneBank::
+threadFunction()
+{
+	unsigned periodSize = inQueue.getElementSize();
+
+	while (!doShutdown) {
+		SamplingType* inBuffer = inQueue.pop_front();
+		if (inBuffer == nullptr) {
+			continue;
+		}
+
+		const ElementInfo& info = Queue<SamplingType>::info(inBuffer);
+		if (info.lostFrames > 0) {
+			dft->reset();
+			countdown = settings.hopSize;
+			lostFrames += info.lostFrames;
+		}
+
+		unsigned valid = periodSize - info.padding;
+		unsigned offset = 0;
+		while (offset < valid && !doShutdown) {
+			unsigned count = std::min(valid - offset, countdown);
+			dft->append(inBuffer + offset, count);
+			offset += count;
+			countdown -= count;
+			if (countdown > 0) {
+				break;
+			}
+			countdown = settings.hopSize;
+			if (!dft->full()) {
+				continue;
+			}
+
+			SpectrumType* levels = allocate(settings.lossless);
+			if (levels == nullptr) {
+				lostFrames++;
+				continue;
+			}
+			dft->levels(levels, settings.scale);
+			ElementInfo& outInfo = Queue<SpectrumType>::info(levels);
+			outInfo.captureTime = info.captureTime;
+			outInfo.lostFrames = lostFrames;
+			lostFrames = 0;
+			outQueue.push_back(levels);
+		}
+
+		if (info.endOfStream) {
+			SpectrumType* marker = allocate(true);
+			if (marker != nullptr) {
+				Queue<SpectrumType>::info(marker).endOfStream = true;
+				outQueue.push_back(marker);
+			}
+		}
+		inQueue.release(inBuffer);
+	}
+}
+
+/**
+ * Waits for a free element if asked to, until shutdown.
+ */
+SpectrumType*
+ToneBank::
+allocate(bool wait)
+{
+	SpectrumType* element = outQueue.allocate();
+	while (element == nullptr && wait && !doShutdown) {
+		element = outQueue.allocate();
+	}
+	return element;
+}
+
+} // namespace
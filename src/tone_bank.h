@@ -0,0 +1,160 @@
+
+#ifndef __TONE_BANK__H
+#define __TONE_BANK__H
+
+#include <atomic>
+#include <complex>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/logger.h"
+#include "utils/queue.h"
+#include "spectrum.h"
+#include "window.h"
+#include "defs.h"
+
+namespace ockl {
+
+/**
+ * Parses a comma separated list of frequencies [Hz], e.g. "24000,48000".
+ * \throws std::runtime_error for an invalid list
+ */
+std::vector<double> parseTones(const std::string& value);
+
+/**
+ * Sliding DFT of a few frequencies over the last `windowSize` samples: every
+ * new sample updates each bin with one complex multiply-add, so the cost per
+ * sample is O(bins) no matter how long the window is, and the levels can be
+ * read after any sample.
+ *
+ * With S(w) = sum x[n - i] w^i over the window, a new sample gives
+ * S'(w) = x[n] + w S(w) - w^windowSize x[n - windowSize]. The frequencies do
+ * not have to be on the fft grid. A cosine sum window (see
+ * windowCoefficients) multiplies the samples with cosines of the window
+ * length, which is the same as combining the bins one fft bin apart, so a
+ * window with M + 1 coefficients costs 2 M + 1 bins per frequency and the
+ * levels come out exactly as in the fft bin of the same frequency.
+ *
+ * The recursion accumulates rounding errors, therefore the bins are
+ * recomputed from the stored window every RefreshWindows windows.
+ */
+class SlidingDft {
+public:
+	/**
+	 * \param frequencies  [Hz], up to nyquist
+	 * \throws std::runtime_error for a frequency out of range
+	 */
+	SlidingDft(const std::vector<double>& frequencies, unsigned samplingRate,
+			unsigned windowSize, Window window);
+
+	void append(const SamplingType* input, unsigned count);
+
+	/**
+	 * \return  whether a whole window has been appended since the last
+	 *          reset
+	 */
+	bool full() const;
+
+	void reset();
+
+	/**
+	 * One value per frequency, scaled like the spectra of Fft.
+	 */
+	void levels(SpectrumType* values, Scale scale);
+
+private:
+	static const unsigned RefreshWindows = 64;
+
+	void update(const SamplingType* input, unsigned count);
+	void refresh();
+
+	unsigned toneCount;
+	unsigned windowSize;
+	/**
+	 * bins per frequency, 2 M + 1 for M + 1 window coefficients
+	 */
+	unsigned binsPerTone;
+	unsigned binCount;
+	double gain;
+
+	// the bins as structure of arrays, so the update loop vectorizes
+	std::vector<double> real;
+	std::vector<double> imaginary;
+	std::vector<double> stepReal;
+	std::vector<double> stepImaginary;
+	std::vector<double> windowStepReal;
+	std::vector<double> windowStepImaginary;
+	/**
+	 * factor of every bin in the windowed sum of its frequency
+	 */
+	std::vector<std::complex<double>> coefficients;
+	std::vector<SpectrumType> combined;
+
+	/**
+	 * the last windowSize samples, the oldest at `position`
+	 */
+	std::vector<double> samples;
+	unsigned position;
+	uint64_t appended;
+	uint64_t untilRefresh;
+};
+
+struct ToneSettings {
+	std::vector<double> frequencies;
+	unsigned windowSize;
+	unsigned hopSize;
+	Window window;
+	Scale scale;
+	/**
+	 * see FftSettings
+	 */
+	bool lossless;
+};
+
+/**
+ * Replacement of Fft for monitoring a fixed set of frequencies: instead of
+ * transforming the whole window every hop, a SlidingDft follows the
+ * frequencies sample by sample, and every hopSize samples the levels over
+ * the last windowSize samples are pushed as one element (one value per
+ * frequency). Gaps and the end of stream are handled like in Fft.
+ */
+class ToneBank {
+public:
+	ToneBank(const ToneSettings& settings,
+			unsigned samplingRate,
+			Queue<SamplingType>& inQueue,
+			Queue<SpectrumType>& outQueue,
+			const Logger& logger);
+	~ToneBank();
+
+	void init();
+	void start();
+	void shutdown();
+
+private:
+	void threadFunction();
+	SpectrumType* allocate(bool wait);
+
+	ToneSettings settings;
+	unsigned samplingRate;
+	std::unique_ptr<SlidingDft> dft;
+	/**
+	 * samples until the next output element
+	 */
+	unsigned countdown;
+	uint64_t lostFrames;
+
+	Queue<SamplingType>& inQueue;
+	Queue<SpectrumType>& outQueue;
+
+	const Logger& logger;
+
+	std::thread* thread;
+	std::atomic<bool> doShutdown;
+};
+
+} // namespace
+
+#endif
@@ -1,33 +1,126 @@
 
+#include <algorithm>
+#include <cmath>
+
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
-MainWindow::MainWindow(ockl::Queue<double>& queue, ockl::Logger& logger, double fftResolution)
+namespace {
+
+/**
+ * Range of the y axis in decibel to start with, the linear scales start
+ * from 0 to the top of it.
+ */
+QCPRange
+decibelRange(const ockl::Calibration& calibration)
+{
+	switch (calibration.unit) {
+	case ockl::Unit::Sample:
+		return calibration.density ? QCPRange(-60, 60) : QCPRange(-20, 100);
+	case ockl::Unit::FullScale:
+		return calibration.density ? QCPRange(-180, -40) : QCPRange(-140, 0);
+	case ockl::Unit::Volt:
+		return calibration.density ? QCPRange(-180, -20) : QCPRange(-140, 20);
+	}
+	return QCPRange(-20, 100);
+}
+
+} // namespace
+
+MainWindow::MainWindow(const std::vector<ockl::Queue<ockl::SpectrumType>*>& queues,
+		ockl::Logger& logger,
+		const ockl::FrequencyAxis& axis, ockl::Scale scale,
+		const ockl::Calibration& calibration,
+		unsigned waterfallRows,
+		const ockl::PeakSettings& peakSettings,
+		ockl::Histogram& renderTimes)
 : QMainWindow(nullptr),
   ui(new Ui::MainWindow),
-  queue(queue),
+  queues(queues),
   logger(logger),
-  dataLength(queue.getElementSize()),
+  dataLength(queues.front()->getElementSize()),
+  axis(axis),
   x(dataLength),
-  y(dataLength)
+  spectra(queues.size(), std::vector<ockl::SpectrumType>(dataLength)),
+  fresh(queues.size(), false),
+  rangeChanged(false),
+  renderTimes(renderTimes)
 {
 	ui->setupUi(this);
 	setGeometry(400, 250, 542, 390);
 
 	timerId = startTimer(10);
 
-	ui->customPlot->addGraph();
+	// one graph per channel, overlayed in different colors
+	for (unsigned channel = 0; channel < queues.size(); channel++) {
+		QCPGraph* graph = ui->customPlot->addGraph();
+		graph->setPen(QPen(QColor::fromHsv(
+				(240 + channel * 360 / queues.size()) % 360, 255, 200)));
+		graph->setName(QString("channel %1").arg(channel));
+	}
+	ui->customPlot->legend->setVisible(queues.size() > 1);
+
+	for (unsigned channel = 0; channel < queues.size()
+			&& peakSettings.count > 0; channel++) {
+		peakFinders.emplace_back(new ockl::PeakFinder(peakSettings, dataLength,
+				axis, scale));
+		QCPGraph* graph = ui->customPlot->addGraph();
+		graph->setPen(ui->customPlot->graph(channel)->pen());
+		graph->setLineStyle(QCPGraph::lsNone);
+		graph->setScatterStyle(QCPScatterStyle(
+				QCPScatterStyle::ssTriangleInverted, 8));
+		graph->removeFromLegend();
+		markers.push_back(graph);
+	}
 
 	ui->customPlot->xAxis->setLabel("Hz");
-	ui->customPlot->yAxis->setLabel(""); // TODO: should be something like dB
-	ui->customPlot->xAxis->setRange(0, fftResolution * dataLength);
-	ui->customPlot->yAxis->setRange(0, 10000.0);
+	if (axis.logarithmic) {
+		ui->customPlot->xAxis->setScaleType(QCPAxis::stLogarithmic);
+	}
+	ui->customPlot->xAxis->setRange(axis.frequency(0),
+			axis.frequency(dataLength));
+
+	// zooming into the frequency axis, the graphs are decimated again for
+	// the new range on the next timer event
+	ui->customPlot->setInteractions(QCP::iRangeDrag | QCP::iRangeZoom);
+	ui->customPlot->axisRect()->setRangeDrag(Qt::Horizontal);
+	ui->customPlot->axisRect()->setRangeZoom(Qt::Horizontal);
+	connect(ui->customPlot->xAxis,
+			static_cast<void (QCPAxis::*)(const QCPRange&)>(
+					&QCPAxis::rangeChanged),
+			this, [this](const QCPRange&) { rangeChanged = true; });
+	ui->customPlot->yAxis->setLabel(QString::fromUtf8(
+			ockl::unitLabel(calibration, scale).c_str()));
+	QCPRange decibels = decibelRange(calibration);
+	switch (scale) {
+	case ockl::Scale::Magnitude:
+		ui->customPlot->yAxis->setRange(0, pow(10, decibels.upper / 20));
+		break;
+	case ockl::Scale::Power:
+		ui->customPlot->yAxis->setRange(0, pow(10, decibels.upper / 10));
+		break;
+	case ockl::Scale::Decibel:
+		ui->customPlot->yAxis->setRange(decibels);
+		break;
+	}
+
+	// below the graphs, using the y range of the graphs for the colors
+	for (unsigned channel = 0; channel < queues.size() && waterfallRows > 0;
+			channel++) {
+		QCPRange range = ui->customPlot->yAxis->range();
+		waterfalls.push_back(new Waterfall(dataLength, waterfallRows,
+				range.lower, range.upper, ui->centralWidget));
+		ui->verticalLayout->addWidget(waterfalls.back());
+	}
+	if (waterfallRows > 0) {
+		setGeometry(400, 250, 542, 390 + 200 * queues.size());
+	}
 
 	setWindowTitle("Spectrum Analyzer");
 	statusBar()->clearMessage();
 
 	for (unsigned i = 0; i < dataLength; i++) {
-		x[i] = fftResolution * i;
+		x[i] = axis.frequency(i);
 	}
 }
 
@@ -41,14 +134,125 @@ void
 MainWindow::
 timerEvent(QTimerEvent*)
 {
-	double* data = queue.pop_front(true);
-	if (data == nullptr) {
-		return;
-    }
+	auto start = std::chrono::steady_clock::now();
+	bool updated = rangeChanged;
+	for (unsigned channel = 0; channel < queues.size(); channel++) {
+		// only the newest spectrum is drawn, so the display is at most one
+		// spectrum behind no matter how fast they arrive
+		ockl::SpectrumType* data = queues[channel]->pop_latest();
+		if (data == nullptr) {
+			continue;
+		}
+		// the end of a file, the marker holds no spectrum
+		if (ockl::Queue<ockl::SpectrumType>::info(data).endOfStream) {
+			queues[channel]->release(data);
+			continue;
+		}
 
-	qCopy(data, data + dataLength, y.begin());
-	queue.release(data);
+		std::copy(data, data + dataLength, spectra[channel].begin());
+		if (!waterfalls.empty()) {
+			waterfalls[channel]->addSpectrum(data);
+		}
+		queues[channel]->release(data);
+
+		fresh[channel] = true;
+		updated = true;
+	}
+
+	if (!updated) {
+		return;
+	}
 
-	ui->customPlot->graph(0)->setData(x, y);
+	for (unsigned channel = 0; channel < queues.size(); channel++) {
+		if (fresh[channel] || rangeChanged) {
+			decimate(channel);
+			fresh[channel] = false;
+		}
+	}
+	rangeChanged = false;
+	markPeaks();
 	ui->customPlot->replot();
+	renderTimes.record(std::chrono::steady_clock::now() - start);
+}
+
+/**
+ * Puts the markers on the peaks of the latest spectra and lists them in
+ * the status bar.
+ */
+void
+MainWindow::
+markPeaks()
+{
+	if (peakFinders.empty()) {
+		return;
+	}
+
+	QString message;
+	for (unsigned channel = 0; channel < queues.size(); channel++) {
+		const ockl::Peaks& peaks = peakFinders[channel]->find(
+				spectra[channel].data());
+		QVector<double> frequencies;
+		QVector<double> levels;
+		if (queues.size() > 1) {
+			message += QString("%1: ").arg(channel);
+		}
+		for (const ockl::Peak& peak : peaks.peaks) {
+			frequencies.push_back(peak.frequency);
+			levels.push_back(peak.level);
+			message += QString("%1 Hz (SNR %2 dB)  ")
+					.arg(peak.frequency, 0, 'f', 1)
+					.arg(peak.snr, 0, 'f', 1);
+		}
+		if (!std::isnan(peaks.thd)) {
+			message += QString("THD %1 dB  ").arg(peaks.thd, 0, 'f', 1);
+		}
+		markers[channel]->setData(frequencies, levels);
+	}
+	statusBar()->showMessage(message);
+}
+
+/**
+ * Hands the visible part of the spectrum to the graph. If there are more
+ * bins than pixels, every pixel column gets two points, the minimum and
+ * the maximum of the bins it covers, so the graph still shows every peak
+ * but the plotting cost only depends on the width of the plot.
+ */
+void
+MainWindow::
+decimate(unsigned channel)
+{
+	const std::vector<ockl::SpectrumType>& spectrum = spectra[channel];
+	QCPRange range = ui->customPlot->xAxis->range();
+	int first = std::max(0.0, floor(axis.bin(range.lower)));
+	int last = std::min((double) dataLength, ceil(axis.bin(range.upper)) + 1);
+	if (last <= first) {
+		ui->customPlot->graph(channel)->setData(QVector<double>(),
+				QVector<double>());
+		return;
+	}
+
+	unsigned count = last - first;
+	unsigned columns = std::max(1, ui->customPlot->axisRect()->width());
+	if (count <= 2 * columns) {
+		values.resize(count);
+		std::copy(spectrum.begin() + first, spectrum.begin() + last,
+				values.begin());
+		ui->customPlot->graph(channel)->setData(x.mid(first, count), values);
+		return;
+	}
+
+	keys.resize(2 * columns);
+	values.resize(2 * columns);
+	for (unsigned column = 0; column < columns; column++) {
+		unsigned begin = first + (uint64_t) column * count / columns;
+		unsigned end = first + (uint64_t) (column + 1) * count / columns;
+		auto minmax = std::minmax_element(spectrum.begin() + begin,
+				spectrum.begin() + end);
+		// distinct keys, the graph would merge points with equal keys
+		keys[2 * column] = x[begin];
+		values[2 * column] = *minmax.first;
+		keys[2 * column + 1] = x[(begin + end) / 2];
+		values[2 * column + 1] = *minmax.second;
+	}
+	ui->customPlot->graph(channel)->setData(keys, values);
 }
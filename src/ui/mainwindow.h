@@ -2,11 +2,19 @@
 #ifndef __MAINWINDOW__H
 #define __MAINWINDOW__H
 
+#include <memory>
+#include <vector>
+
 #include <QtWidgets/QMainWindow>
 #include <qcustomplot.h>
 
+#include "../utils/histogram.h"
 #include "../utils/queue.h"
 #include "../utils/logger.h"
+#include "../calibration.h"
+#include "../peak_finder.h"
+#include "../spectrum.h"
+#include "waterfall.h"
 
 namespace Ui {
 class MainWindow;
@@ -15,21 +23,53 @@ class MainWindow;
 class MainWindow : public QMainWindow {
 	Q_OBJECT
 public:
-	explicit MainWindow(ockl::Queue<double>& queue, ockl::Logger& logger, double fftResolution);
+	explicit MainWindow(const std::vector<ockl::Queue<ockl::SpectrumType>*>& queues,
+			ockl::Logger& logger,
+			const ockl::FrequencyAxis& axis, ockl::Scale scale,
+			const ockl::Calibration& calibration,
+			unsigned waterfallRows,
+			const ockl::PeakSettings& peakSettings,
+			ockl::Histogram& renderTimes);
 	~MainWindow();
 
 private:
 	void timerEvent(QTimerEvent*) override;
+	void decimate(unsigned channel);
+	void markPeaks();
 
 	Ui::MainWindow *ui;
 	int timerId;
 
-	ockl::Queue<double>& queue;
+	std::vector<ockl::Queue<ockl::SpectrumType>*> queues;
 	ockl::Logger& logger;
 	unsigned dataLength;
+	ockl::FrequencyAxis axis;
+	/**
+	 * one per channel, empty if disabled
+	 */
+	std::vector<Waterfall*> waterfalls;
+	/**
+	 * one per channel, empty if disabled, the peaks are drawn as an extra
+	 * graph per channel
+	 */
+	std::vector<std::unique_ptr<ockl::PeakFinder>> peakFinders;
+	std::vector<QCPGraph*> markers;
 
 	QVector<double> x;
-	QVector<double> y;
+	/**
+	 * latest spectrum of every channel, in the precision of the pipeline,
+	 * the graphs only get as many points (as double for QCustomPlot) as
+	 * there are pixels
+	 */
+	std::vector<std::vector<ockl::SpectrumType>> spectra;
+	std::vector<bool> fresh;
+	bool rangeChanged;
+	QVector<double> keys;
+	QVector<double> values;
+	/**
+	 * from taking the spectra to the end of the replot
+	 */
+	ockl::Histogram& renderTimes;
 };
 
 #endif
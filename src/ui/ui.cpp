@@ -8,11 +8,18 @@ namespace ockl {
 
 void
 Ui::
-run(Queue<double>& queue, Logger& logger, double fftResolution)
+run(const std::vector<Queue<SpectrumType>*>& queues, Logger& logger,
+		const FrequencyAxis& axis,
+		Scale scale,
+		const Calibration& calibration,
+		unsigned waterfallRows,
+		const PeakSettings& peakSettings,
+		Histogram& renderTimes)
 {
 	int argc = 0;
 	QApplication a(argc, nullptr);
-	MainWindow w(queue, logger, fftResolution);
+	MainWindow w(queues, logger, axis, scale, calibration, waterfallRows,
+			peakSettings, renderTimes);
 	w.show();
 	a.exec();
 }
@@ -2,14 +2,36 @@
 #ifndef __UI__H
 #define __UI__H
 
+#include <vector>
+
+#include "../utils/histogram.h"
 #include "../utils/queue.h"
 #include "../utils/logger.h"
+#include "../calibration.h"
+#include "../peak_finder.h"
+#include "../spectrum.h"
 
 namespace ockl {
 
 class Ui {
 public:
-	void run(Queue<double>& queue, Logger& logger, double fftResolution);
+	/**
+	 * \param queues         one queue per channel, every channel gets its
+	 *                       own graph
+	 * \param axis           frequencies of the bins
+	 * \param calibration    unit of the spectra, for the y axis
+	 * \param waterfallRows  length of the spectrogram history below the
+	 *                       graphs, 0 to hide it
+	 * \param peakSettings   peaks to mark in the graphs
+	 * \param renderTimes    gets the time every update of the window takes
+	 */
+	void run(const std::vector<Queue<SpectrumType>*>& queues, Logger& logger,
+			const FrequencyAxis& axis,
+			Scale scale,
+			const Calibration& calibration,
+			unsigned waterfallRows,
+			const PeakSettings& peakSettings,
+			Histogram& renderTimes);
 };
 
 }
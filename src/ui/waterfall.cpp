@@ -0,0 +1,71 @@
+
+#include <algorithm>
+
+#include <QtGui/QPainter>
+
+#include "waterfall.h"
+
+Waterfall::
+Waterfall(unsigned bins, unsigned rows, double minimum, double maximum,
+		QWidget* parent)
+: QWidget(parent),
+  bins(bins),
+  rows(rows),
+  minimum(minimum),
+  scale((PaletteSize - 1) / (maximum - minimum)),
+  image(bins < MaxColumns ? bins : MaxColumns, rows, QImage::Format_RGB32),
+  head(0),
+  columnStart(image.width() + 1),
+  palette(PaletteSize)
+{
+	image.fill(Qt::black);
+	setMinimumHeight(100);
+	setAttribute(Qt::WA_OpaquePaintEvent);
+
+	for (unsigned column = 0; column <= (unsigned) image.width(); column++) {
+		columnStart[column] = (uint64_t) column * bins / image.width();
+	}
+
+	// dark blue over cyan, green and yellow to red
+	for (unsigned i = 0; i < PaletteSize; i++) {
+		palette[i] = QColor::fromHsv(240 - i * 240 / (PaletteSize - 1), 255,
+				std::min(255u, 64 + i * 2)).rgb();
+	}
+}
+
+void
+Waterfall::
+addSpectrum(const ockl::SpectrumType* spectrum)
+{
+	// The lines are written backwards through the image, so the newest
+	// rows always follow each other downwards from the head.
+	head = (head + rows - 1) % rows;
+	QRgb* line = (QRgb*) image.scanLine(head);
+
+	for (int column = 0; column < image.width(); column++) {
+		double value = *std::max_element(spectrum + columnStart[column],
+				spectrum + columnStart[column + 1]);
+		double index = (value - minimum) * scale;
+		line[column] = palette[index <= 0 ? 0
+				: index >= PaletteSize - 1 ? PaletteSize - 1
+				: (unsigned) index];
+	}
+
+	update();
+}
+
+void
+Waterfall::
+paintEvent(QPaintEvent*)
+{
+	QPainter painter(this);
+	double rowHeight = (double) height() / rows;
+	unsigned newer = rows - head;
+
+	painter.drawImage(QRectF(0, 0, width(), newer * rowHeight),
+			image, QRectF(0, head, image.width(), newer));
+	if (head > 0) {
+		painter.drawImage(QRectF(0, newer * rowHeight, width(), head * rowHeight),
+				image, QRectF(0, 0, image.width(), head));
+	}
+}
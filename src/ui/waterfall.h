@@ -0,0 +1,58 @@
+#ifndef __WATERFALL__H
+#define __WATERFALL__H
+
+#include <vector>
+
+#include <QtGui/QImage>
+#include <QtWidgets/QWidget>
+
+#include "../defs.h"
+
+/**
+ * Spectrogram: every spectrum becomes one row of pixels, the newest row on
+ * top. The rows live in a ring of image lines, so adding a spectrum only
+ * converts that one row and painting draws the image in two pieces (from
+ * the newest row to the end of the image, then from the start of the image
+ * to the oldest row), instead of redrawing the whole history.
+ *
+ * Spectra wider than MaxColumns bins are reduced on the way in, every
+ * column showing the maximum of the bins it covers, so narrow peaks do not
+ * disappear.
+ */
+class Waterfall : public QWidget {
+	Q_OBJECT
+public:
+	/**
+	 * \param bins     length of the spectra
+	 * \param rows     number of spectra in the history
+	 * \param minimum  value drawn with the first color of the palette
+	 * \param maximum  value drawn with the last color of the palette
+	 */
+	Waterfall(unsigned bins, unsigned rows, double minimum, double maximum,
+			QWidget* parent = nullptr);
+
+	void addSpectrum(const ockl::SpectrumType* spectrum);
+
+private:
+	static const unsigned MaxColumns = 4096;
+	static const unsigned PaletteSize = 256;
+
+	void paintEvent(QPaintEvent*) override;
+
+	unsigned bins;
+	unsigned rows;
+	double minimum;
+	double scale;
+	QImage image;
+	/**
+	 * image line of the newest spectrum
+	 */
+	unsigned head;
+	/**
+	 * first bin of every column, plus the end
+	 */
+	std::vector<unsigned> columnStart;
+	std::vector<QRgb> palette;
+};
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef __HISTOGRAM__H
+#define __HISTOGRAM__H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace ockl {
+
+/**
+ * Latency distribution in microseconds, recorded by one or more threads
+ * and read by another without a lock.
+ *
+ * The buckets are log-linear like in an HDR histogram: values below
+ * 2 * SubBuckets get a bucket each, above that every power of two is split
+ * into SubBuckets buckets, so a percentile is off by at most 1 / SubBuckets
+ * (3%) of its value, from 1 us up to days, in a fixed ~10 KiB of counters.
+ * Recording is a relaxed increment of one counter, the counts are never
+ * reset.
+ */
+class Histogram {
+public:
+	static const unsigned SubBucketBits = 5;
+	static const unsigned SubBuckets = 1u << SubBucketBits;
+	/**
+	 * larger values are counted as this
+	 */
+	static const uint64_t MaxValue = (uint64_t(1) << 40) - 1;
+
+	/**
+	 * A consistent copy of the counters, to compute percentiles from.
+	 */
+	struct Snapshot {
+		std::vector<uint64_t> counts;
+		uint64_t count;
+		uint64_t sum;
+
+		/**
+		 * \param quantile  0..1, e.g. 0.99
+		 * \return          the highest value of the bucket holding the
+		 *                  quantile [us], 0 if nothing was recorded
+		 */
+		uint64_t percentile(double quantile) const
+		{
+			if (count == 0) {
+				return 0;
+			}
+			uint64_t rank = (uint64_t) (quantile * count);
+			if (rank >= count) {
+				rank = count - 1;
+			}
+			uint64_t seen = 0;
+			for (unsigned index = 0; index < counts.size(); index++) {
+				seen += counts[index];
+				if (seen > rank) {
+					return highestValue(index);
+				}
+			}
+			return MaxValue;
+		}
+	};
+
+	Histogram()
+	: counts(bucketIndex(MaxValue) + 1),
+	  sum(0)
+	{
+		for (auto& count : counts) {
+			count.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	Histogram(const Histogram&) = delete;
+	Histogram& operator=(const Histogram&) = delete;
+
+	void record(uint64_t microseconds)
+	{
+		if (microseconds > MaxValue) {
+			microseconds = MaxValue;
+		}
+		counts[bucketIndex(microseconds)].fetch_add(1,
+				std::memory_order_relaxed);
+		sum.fetch_add(microseconds, std::memory_order_relaxed);
+	}
+
+	template <typename Duration>
+	void record(Duration duration)
+	{
+		auto microseconds = std::chrono::duration_cast<
+				std::chrono::microseconds>(duration).count();
+		record((uint64_t) (microseconds < 0 ? 0 : microseconds));
+	}
+
+	/**
+	 * Recording goes on meanwhile, so the snapshot might miss a few
+	 * values, but its count matches its buckets.
+	 */
+	Snapshot snapshot() const
+	{
+		Snapshot snapshot{std::vector<uint64_t>(counts.size()), 0,
+			sum.load(std::memory_order_relaxed)};
+		for (unsigned index = 0; index < counts.size(); index++) {
+			snapshot.counts[index] = counts[index].load(
+					std::memory_order_relaxed);
+			snapshot.count += snapshot.counts[index];
+		}
+		return snapshot;
+	}
+
+private:
+	/**
+	 * Below 2 * SubBuckets the value itself, above the bucket of the
+	 * SubBucketBits + 1 leading bits of the value.
+	 */
+	static unsigned bucketIndex(uint64_t value)
+	{
+		if (value < 2 * SubBuckets) {
+			return value;
+		}
+		unsigned shift = 63 - __builtin_clzll(value) - SubBucketBits;
+		return shift * SubBuckets + (value >> shift);
+	}
+
+	static uint64_t highestValue(unsigned index)
+	{
+		if (index < 2 * SubBuckets) {
+			return index;
+		}
+		unsigned shift = index / SubBuckets - 1;
+		uint64_t leading = index - shift * SubBuckets;
+		return ((leading + 1) << shift) - 1;
+	}
+
+	std::vector<std::atomic<uint64_t>> counts;
+	std::atomic<uint64_t> sum;
+};
+
+} // namespace
+
+#endif
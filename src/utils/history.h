@@ -0,0 +1,66 @@
+
+#ifndef __HISTORY__H
+#define __HISTORY__H
+
+#include <algorithm>
+#include <vector>
+
+namespace ockl {
+
+/**
+ * Ring of the most recent `length` samples. Every sample is stored twice,
+ * `length` elements apart, so that the latest `length` samples can always
+ * be read as one contiguous block without moving the history around.
+ */
+template <typename T>
+class History {
+public:
+	explicit History(unsigned length)
+	: length(length),
+	  position(0),
+	  fill(0),
+	  buffer(2 * length)
+	{
+	}
+
+	template <typename Input>
+	void append(const Input* data, unsigned count)
+	{
+		for (unsigned i = 0; i < count; i++) {
+			buffer[position] = buffer[position + length] = (T) data[i];
+			if (++position == length) {
+				position = 0;
+			}
+		}
+		fill = std::min(fill + count, length);
+	}
+
+	/**
+	 * \return  `length` samples, oldest first
+	 */
+	const T* latest() const
+	{
+		return buffer.data() + position;
+	}
+
+	bool full() const
+	{
+		return fill == length;
+	}
+
+	void clear()
+	{
+		position = 0;
+		fill = 0;
+	}
+
+private:
+	unsigned length;
+	unsigned position;
+	unsigned fill;
+	std::vector<T> buffer;
+};
+
+} // namespace
+
+#endif
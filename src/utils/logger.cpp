@@ -54,6 +54,13 @@ error(const std::string& msg) const
 	log(msg, "ERROR");
 }
 
+void
+Logger::
+configure(const ThreadSettings& settings)
+{
+	configureThread(*thread, settings);
+}
+
 void
 Logger::
 log(const std::string& text, const std::string& level) const
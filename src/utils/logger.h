@@ -9,6 +9,8 @@
 #include <mutex>
 #include <condition_variable>
 
+#include "realtime.h"
+
 namespace ockl {
 
 #define _LOG(level, stream)				\
@@ -33,6 +35,13 @@ public:
 	void warning(const std::string& msg) const;
 	void error(const std::string& msg) const;
 
+	/**
+	 * Applies the scheduling to the thread writing the messages.
+	 *
+	 * \throws std::runtime_error if the scheduler refuses the settings
+	 */
+	void configure(const ThreadSettings& settings);
+
 private:
 	void log(const std::string& msg, const std::string& level) const;
 	void threadFunction();
@@ -0,0 +1,133 @@
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "metrics.h"
+
+namespace ockl {
+
+namespace {
+
+const double Quantiles[] = {0.5, 0.99, 0.999};
+
+/**
+ * \return  `labels` and `extra`, comma separated and in braces, or nothing
+ *          if both are empty
+ */
+std::string
+labelSet(const std::string& labels, const std::string& extra)
+{
+	if (labels.empty() && extra.empty()) {
+		return "";
+	}
+	return "{" + labels + (labels.empty() || extra.empty() ? "" : ",")
+			+ extra + "}";
+}
+
+} // namespace
+
+Metrics::
+Metrics(const std::string& fileName,
+		std::chrono::milliseconds interval,
+		const Logger& logger)
+: fileName(fileName),
+  interval(interval),
+  doShutdown(false),
+  logger(logger)
+{
+	thread = new std::thread(&Metrics::threadFunction, this);
+	pthread_setname_np(thread->native_handle(), "metrics");
+}
+
+Metrics::
+~Metrics()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		doShutdown = true;
+		cv.notify_all();
+	}
+	thread->join();
+	delete thread;
+	dump();
+}
+
+void
+Metrics::
+add(const std::string& name, const std::string& help,
+		const std::string& labels, const Histogram& histogram)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	entries.push_back(Entry{name, help, labels, &histogram});
+}
+
+void
+Metrics::
+write(std::ostream& stream) const
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	stream << std::setprecision(9);
+	for (unsigned i = 0; i < entries.size(); i++) {
+		const Entry& entry = entries[i];
+		if (i == 0 || entries[i - 1].name != entry.name) {
+			stream << "# HELP " << entry.name << " " << entry.help << "\n"
+					<< "# TYPE " << entry.name << " summary\n";
+		}
+		Histogram::Snapshot snapshot = entry.histogram->snapshot();
+		for (double quantile : Quantiles) {
+			std::ostringstream label;
+			label << "quantile=\"" << quantile << "\"";
+			stream << entry.name << labelSet(entry.labels, label.str()) << " "
+					<< snapshot.percentile(quantile) * 1e-6 << "\n";
+		}
+		stream << entry.name << "_sum" << labelSet(entry.labels, "") << " "
+				<< snapshot.sum * 1e-6 << "\n"
+				<< entry.name << "_count" << labelSet(entry.labels, "") << " "
+				<< snapshot.count << "\n";
+	}
+}
+
+void
+Metrics::
+threadFunction()
+{
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (doShutdown) {
+				break;
+			}
+			cv.wait_for(lock, interval);
+			if (doShutdown) {
+				break;
+			}
+		}
+		dump();
+	}
+}
+
+/**
+ * Writes a temporary file next to the target and renames it, readers see
+ * either the old or the new file.
+ */
+void
+Metrics::
+dump() const
+{
+	std::string temporary = fileName + ".tmp";
+	{
+		std::ofstream file(temporary, std::ios::trunc);
+		write(file);
+		if (!file) {
+			LOGGER_ERROR("failed to write metrics to " << temporary);
+			return;
+		}
+	}
+	if (std::rename(temporary.c_str(), fileName.c_str()) != 0) {
+		LOGGER_ERROR("failed to rename " << temporary << " to " << fileName);
+	}
+}
+
+} // namespace
@@ -0,0 +1,73 @@
+#ifndef __METRICS__H
+#define __METRICS__H
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "histogram.h"
+#include "logger.h"
+
+namespace ockl {
+
+/**
+ * Periodically writes the latency histograms of the stages to a file in
+ * the Prometheus text format, as summaries with the 0.5, 0.99 and 0.999
+ * quantiles (in seconds, like Prometheus wants it). The file is replaced
+ * atomically, so it can be read at any time, e.g. by the textfile
+ * collector of the node exporter.
+ *
+ * The histograms are only referenced, they must outlive the Metrics.
+ */
+class Metrics {
+public:
+	/**
+	 * \param interval  time between two writes, the file is written a last
+	 *                  time on destruction
+	 */
+	Metrics(const std::string& fileName,
+			std::chrono::milliseconds interval,
+			const Logger& logger);
+	~Metrics();
+
+	/**
+	 * \param name       metric name, histograms of the same name must be
+	 *                   added one after the other
+	 * \param help       description of the metric
+	 * \param labels     e.g. "queue=\"fft\",channel=\"0\"", may be empty
+	 */
+	void add(const std::string& name, const std::string& help,
+			const std::string& labels, const Histogram& histogram);
+
+	void write(std::ostream& stream) const;
+
+private:
+	void threadFunction();
+	void dump() const;
+
+	struct Entry {
+		std::string name;
+		std::string help;
+		std::string labels;
+		const Histogram* histogram;
+	};
+
+	const std::string fileName;
+	std::chrono::milliseconds interval;
+	std::vector<Entry> entries;
+
+	std::thread* thread;
+	bool doShutdown;
+	mutable std::mutex mutex;
+	std::condition_variable cv;
+
+	const Logger& logger;
+};
+
+} // namespace
+
+#endif
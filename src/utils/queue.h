@@ -2,23 +2,78 @@
 #ifndef __QUEUE__H
 #define __QUEUE__H
 
+#include <atomic>
 #include <chrono>
-#include <deque>
+#include <cstdlib>
 #include <mutex>
+#include <new>
 #include <condition_variable>
+#include <cstdint>
+#include <stdexcept>
 #include <utility>
 
+#include "histogram.h"
+
 namespace ockl {
 
 class QueueStatistics {
 public:
 	virtual ~QueueStatistics() {}
 
+	/**
+	 * \param droppedElements  elements skipped by pop_latest()
+	 */
 	virtual void getStats(unsigned& producerTimeouts,
 			std::chrono::microseconds& holdTime,
-			unsigned& queueLength) = 0;
+			unsigned& queueLength,
+			unsigned& droppedElements) = 0;
 };
 
+/**
+ * Metadata travelling along with every element of a Queue. It is reset when
+ * the element is allocated.
+ */
+struct ElementInfo {
+	/**
+	 * Number of frames missing right in front of the first sample of this
+	 * element (e.g. lost in an overrun of the capture device). Consumers
+	 * must not treat the data as continuous across such a gap.
+	 */
+	uint64_t lostFrames;
+	/**
+	 * Last element of a finite stream (e.g. a file). Its data is not valid
+	 * beyond the end of the stream, consumers pass the marker on and stop.
+	 */
+	bool endOfStream;
+	/**
+	 * Number of values at the end of the element which are not part of the
+	 * stream (the zero padding of the last element of a file), only the
+	 * first `element size - padding` are valid.
+	 */
+	unsigned padding;
+	/**
+	 * When the first sample of the element was captured (for files: the
+	 * offset from the start of the file).
+	 */
+	std::chrono::system_clock::time_point captureTime;
+};
+
+/**
+ * Single producer, single consumer queue of preallocated elements.
+ *
+ * The producer allocate()s an element, fills it and push_back()s it, the
+ * consumer pop_front()s it and release()s it back to the pool. Pool and
+ * queue are two lock-free rings, so push_back() and release() never block
+ * and allocate() and pop_front() only fall back to a condition variable
+ * when their ring is empty.
+ *
+ * Only one thread may call allocate()/push_back()/unallocate() and only one
+ * thread may call pop_front()/pop_latest()/release(). Every ring has a
+ * single pushing thread, so a producer which has to give an element back
+ * without pushing it unallocate()s it, release() is for the consumer only.
+ *
+ * Every element carries an ElementInfo, see info().
+ */
 template <typename T>
 class Queue : public QueueStatistics {
 public:
@@ -34,12 +89,23 @@ public:
 	: elementSize(elementSize),
 	  elementCount(elementCount),
 	  timeout(timeout),
+	  slotSize(align(sizeof(Header)) + align(sizeof(T) * elementSize)),
 	  producerTimeouts(0),
 	  maxHoldTime(0),
+	  droppedElements(0),
+	  pool(elementCount),
+	  queue(elementCount),
+	  spare(elementCount),
+	  waiters(0),
 	  doShutdown(false)
 	{
+		if (::posix_memalign((void**) &slots, CacheLineSize,
+				slotSize * elementCount) != 0) {
+			throw std::bad_alloc();
+		}
 		for (unsigned i = 0; i < elementCount; i++) {
-			pool.push_back((T*) malloc(sizeof(T) * elementSize));
+			new (slots + i * slotSize) Header();
+			pool.push(data(slots + i * slotSize));
 		}
 	}
 
@@ -47,107 +113,136 @@ public:
 	{
 		std::unique_lock<std::mutex> lock(mutex);
 		doShutdown = true;
-		while (pool.size() + queue.size() != elementCount) {
-			cv.wait(lock);
-		}
-		for (unsigned i = 0; i < pool.size(); i++) {
-			free(pool[i]);
-		}
-		for (unsigned i = 0; i < queue.size(); i++) {
-			free(queue[i]);
+		while (pool.size() + queue.size() + spare.size() != elementCount) {
+			waiters++;
+			cv.wait_for(lock, timeout);
+			waiters--;
 		}
+		free(slots);
 	}
 
 	void shutdown()
 	{
 		std::unique_lock<std::mutex> lock(mutex);
 		doShutdown = true;
+		cv.notify_all();
 	}
 
 	T* allocate()
 	{
-		std::unique_lock<std::mutex> lock(mutex);
 		if (doShutdown) {
 			return nullptr;
 		}
-		if (pool.empty()) {
-			cv.wait_for(lock, timeout);
-		}
-		if (doShutdown) {
-			return nullptr;
-		}
-		if (pool.empty()) {
-			producerTimeouts++;
+		T* element = nullptr;
+		if (!spare.pop(element)
+				&& !wait([&] { return pool.pop(element); })) {
+			if (!doShutdown) {
+				producerTimeouts++;
+			}
 			return nullptr;
 		}
-		T* element = pool.front();
-		pool.pop_front();
+		header(element)->info = ElementInfo();
 		return element;
 	}
 
+	/**
+	 * Gives an allocated element back without pushing it (producer only),
+	 * the next allocate() returns it again.
+	 */
+	void unallocate(T* data)
+	{
+		if (data == nullptr) {
+			throw new std::runtime_error("unallocate(nullptr)");
+		}
+		spare.push(data);
+	}
+
+	/**
+	 * 
+eturn  whether allocate() would return an element without waiting
+	 *          (producer only, the consumer can only add to the pool)
+	 */
+	bool available() const
+	{
+		return spare.size() > 0 || pool.size() > 0;
+	}
+
 	void push_back(T* data)
 	{
 		if (data == nullptr) {
 			throw new std::runtime_error("push_back(nullptr)");
 		}
-		std::unique_lock<std::mutex> lock(mutex);
-		queue.push_back(data);
-		times.push_back(std::chrono::system_clock::now());
-		cv.notify_all();
+		header(data)->insertionTime = std::chrono::steady_clock::now();
+		queue.push(data);
+		notify();
 	}
 
 	T* pop_front(bool nowait = false)
 	{
-		std::unique_lock<std::mutex> lock(mutex);
 		if (doShutdown) {
 			return nullptr;
 		}
-		if (queue.empty()) {
-			if (nowait) {
-				return nullptr;
-			}
-			cv.wait_for(lock, timeout);
+		T* element = nullptr;
+		if (nowait ? !queue.pop(element)
+				: !wait([&] { return queue.pop(element); })) {
+			return nullptr;
 		}
+		updateHoldTime(element);
+		return element;
+	}
+
+	/**
+	 * For consumers which only care about the newest element (e.g. a
+	 * display): returns the newest element without waiting and hands all
+	 * older ones straight back to the pool, counting them as dropped.
+	 */
+	T* pop_latest()
+	{
 		if (doShutdown) {
 			return nullptr;
 		}
-		if (queue.empty()) {
+		T* latest = nullptr;
+		T* element = nullptr;
+		unsigned dropped = 0;
+		while (queue.pop(element)) {
+			if (latest != nullptr) {
+				pool.push(latest);
+				dropped++;
+			}
+			latest = element;
+		}
+		if (latest == nullptr) {
 			return nullptr;
 		}
-		T* element = queue.front();
-		queue.pop_front();
-		auto insertionTime = times.front();
-		times.pop_front();
-		auto holdTime = std::chrono::system_clock::now() - insertionTime;
-		if (holdTime > maxHoldTime) {
-			maxHoldTime = std::chrono::duration_cast<std::chrono::microseconds>(
-					holdTime);
+		if (dropped > 0) {
+			droppedElements += dropped;
+			notify();
 		}
-		return element;
+		updateHoldTime(latest);
+		return latest;
 	}
 
+	/**
+	 * Returns a popped element to the pool (consumer only).
+	 */
 	void release(T* data)
 	{
 		if (data == nullptr) {
 			throw new std::runtime_error("release(nullptr)");
 		}
-		std::unique_lock<std::mutex> lock(mutex);
-		pool.push_back(data);
-		cv.notify_all();
+		pool.push(data);
+		notify();
 	}
 
 	void getStats(unsigned& producerTimeouts,
 			std::chrono::microseconds& holdTime,
-			unsigned& queueLength) override
+			unsigned& queueLength,
+			unsigned& droppedElements) override
 	{
-		std::unique_lock<std::mutex> lock(mutex);
-
-		producerTimeouts = this->producerTimeouts;
-		holdTime = this->maxHoldTime;
+		producerTimeouts = this->producerTimeouts.exchange(0);
+		holdTime = std::chrono::microseconds(this->maxHoldTime.exchange(0));
 		queueLength = queue.size();
-
-		this->producerTimeouts = 0;
-		this->maxHoldTime = std::chrono::microseconds(0);
+		droppedElements = this->droppedElements.exchange(0);
 	}
 
 	unsigned getElementSize()
@@ -155,20 +250,193 @@ public:
 		return elementSize;
 	}
 
+	/**
+	 * Distribution of the time elements spent in the queue, from
+	 * push_back() to pop_front() / pop_latest(), since the start.
+	 */
+	const Histogram& holdTimes() const
+	{
+		return holdTimeHistogram;
+	}
+
+	/**
+	 * The metadata of an element, set by the producer between allocate()
+	 * and push_back(), read by the consumer between pop_front() and
+	 * release().
+	 */
+	static ElementInfo& info(T* element)
+	{
+		return header(element)->info;
+	}
+
 private:
+	void updateHoldTime(T* element)
+	{
+		auto holdTime = std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::steady_clock::now()
+				- header(element)->insertionTime).count();
+		holdTimeHistogram.record((uint64_t) holdTime);
+		auto max = maxHoldTime.load(std::memory_order_relaxed);
+		while (holdTime > max && !maxHoldTime.compare_exchange_weak(max,
+				holdTime, std::memory_order_relaxed)) {
+		}
+	}
+
+	static const std::size_t CacheLineSize = 64;
+
+	static constexpr std::size_t align(std::size_t size)
+	{
+		return (size + CacheLineSize - 1) / CacheLineSize * CacheLineSize;
+	}
+
+	/**
+	 * Bookkeeping stored in front of every element, on its own cache line.
+	 */
+	struct Header {
+		std::chrono::steady_clock::time_point insertionTime;
+		ElementInfo info;
+	};
+
+	static T* data(char* slot)
+	{
+		return reinterpret_cast<T*>(slot + align(sizeof(Header)));
+	}
+
+	static Header* header(T* data)
+	{
+		return reinterpret_cast<Header*>(
+				reinterpret_cast<char*>(data) - align(sizeof(Header)));
+	}
+
+	/**
+	 * Wait-free ring of element pointers with one pushing and one popping
+	 * thread. Both indices only ever grow and live on their own cache
+	 * line, the popping side keeps a cached copy of the tail.
+	 */
+	class Ring {
+	public:
+		explicit Ring(unsigned minCapacity)
+		: mask(capacityFor(minCapacity) - 1),
+		  elements(new T*[mask + 1]),
+		  tail(0),
+		  head(0),
+		  cachedTail(0)
+		{
+		}
+
+		~Ring()
+		{
+			delete[] elements;
+		}
+
+		Ring(const Ring&) = delete;
+		Ring& operator=(const Ring&) = delete;
+
+		/**
+		 * The ring is never smaller than the number of elements of the
+		 * queue, hence push never has to wait for free space.
+		 */
+		void push(T* element)
+		{
+			auto t = tail.load(std::memory_order_relaxed);
+			elements[t & mask] = element;
+			tail.store(t + 1, std::memory_order_release);
+		}
+
+		bool pop(T*& element)
+		{
+			auto h = head.load(std::memory_order_relaxed);
+			if (h == cachedTail) {
+				cachedTail = tail.load(std::memory_order_acquire);
+				if (h == cachedTail) {
+					return false;
+				}
+			}
+			element = elements[h & mask];
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		unsigned size() const
+		{
+			return (unsigned) (tail.load(std::memory_order_acquire)
+					- head.load(std::memory_order_acquire));
+		}
+
+	private:
+		static std::size_t capacityFor(unsigned minCapacity)
+		{
+			std::size_t capacity = 1;
+			while (capacity < minCapacity) {
+				capacity *= 2;
+			}
+			return capacity;
+		}
+
+		const std::size_t mask;
+		T** const elements;
+
+		char pad0[CacheLineSize];
+		std::atomic<std::size_t> tail;
+		char pad1[CacheLineSize - sizeof(std::size_t)];
+		std::atomic<std::size_t> head;
+		std::size_t cachedTail;
+		char pad2[CacheLineSize - sizeof(std::size_t) * 2];
+	};
+
+	/**
+	 * Only called when the lock-free path failed: registers as waiter
+	 * before checking the ring again, so that a concurrent notify() either
+	 * sees the waiter or the waiter sees the new element.
+	 */
+	template <typename Predicate>
+	bool wait(Predicate predicate)
+	{
+		if (predicate()) {
+			return true;
+		}
+		bool success = false;
+		std::unique_lock<std::mutex> lock(mutex);
+		waiters++;
+		cv.wait_for(lock, timeout, [&] {
+			success = predicate();
+			return success || doShutdown;
+		});
+		waiters--;
+		return success;
+	}
+
+	void notify()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (waiters.load(std::memory_order_relaxed) != 0) {
+			std::unique_lock<std::mutex> lock(mutex);
+			cv.notify_all();
+		}
+	}
+
 	unsigned elementSize;
 	unsigned elementCount;
 
 	std::chrono::milliseconds timeout;
 
-	unsigned producerTimeouts;
-	std::chrono::microseconds maxHoldTime;
+	const std::size_t slotSize;
+	char* slots;
 
-	std::deque<T*> pool;
-	std::deque<T*> queue;
-	std::deque<std::chrono::system_clock::time_point> times;
+	std::atomic<unsigned> producerTimeouts;
+	std::atomic<long long> maxHoldTime;
+	std::atomic<unsigned> droppedElements;
+	Histogram holdTimeHistogram;
+
+	Ring pool;
+	Ring queue;
+	/**
+	 * elements the producer unallocate()d, pushed and popped by it alone
+	 */
+	Ring spare;
 
-	bool doShutdown;
+	std::atomic<unsigned> waiters;
+	std::atomic<bool> doShutdown;
 	mutable std::mutex mutex;
 	std::condition_variable cv;
 };
@@ -0,0 +1,110 @@
+
+#include <cerrno>
+#include <cstring>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+
+#include "realtime.h"
+
+namespace ockl {
+
+void
+parseAffinity(const std::string& spec, std::string& thread,
+		std::vector<unsigned>& cpus)
+{
+	std::size_t colon = spec.find(':');
+	if (colon == std::string::npos || colon == 0) {
+		throw std::runtime_error("affinity needs <thread>:<cpus>");
+	}
+	thread = spec.substr(0, colon);
+	cpus.clear();
+	std::istringstream iss(spec.substr(colon + 1));
+	std::string item;
+	while (std::getline(iss, item, ',')) {
+		std::size_t dash = item.find('-');
+		unsigned first = std::stoi(item.substr(0, dash));
+		unsigned last = dash == std::string::npos ? first
+				: std::stoi(item.substr(dash + 1));
+		if (last < first || last >= CPU_SETSIZE) {
+			throw std::runtime_error("invalid cpu range " + item);
+		}
+		for (unsigned cpu = first; cpu <= last; cpu++) {
+			cpus.push_back(cpu);
+		}
+	}
+	if (cpus.empty()) {
+		throw std::runtime_error("no cpus given for " + thread);
+	}
+}
+
+void
+configureThread(std::thread& thread, const ThreadSettings& settings)
+{
+	if (settings.priority > 0) {
+		::sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = settings.priority;
+		int result = ::pthread_setschedparam(thread.native_handle(),
+				SCHED_FIFO, &param);
+		if (result != 0) {
+			std::ostringstream oss;
+			oss << "failed to set SCHED_FIFO priority " << settings.priority
+					<< ": " << strerror(result);
+			throw std::runtime_error(oss.str());
+		}
+	}
+
+	if (!settings.cpus.empty()) {
+		::cpu_set_t set;
+		CPU_ZERO(&set);
+		for (unsigned cpu : settings.cpus) {
+			CPU_SET(cpu, &set);
+		}
+		int result = ::pthread_setaffinity_np(thread.native_handle(),
+				sizeof(set), &set);
+		if (result != 0) {
+			std::ostringstream oss;
+			oss << "failed to pin thread to cpus: " << strerror(result);
+			throw std::runtime_error(oss.str());
+		}
+	}
+}
+
+std::string
+describe(const ThreadSettings& settings)
+{
+	std::ostringstream oss;
+	if (settings.priority > 0) {
+		oss << "SCHED_FIFO " << settings.priority;
+	} else {
+		oss << "SCHED_OTHER";
+	}
+	if (!settings.cpus.empty()) {
+		oss << ", cpus ";
+		for (unsigned i = 0; i < settings.cpus.size(); i++) {
+			oss << (i > 0 ? "," : "") << settings.cpus[i];
+		}
+	}
+	return oss.str();
+}
+
+void
+lockMemory()
+{
+	if (::mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		std::ostringstream oss;
+		oss << "failed to lock memory: " << strerror(errno)
+				<< " (see ulimit -l)";
+		throw std::runtime_error(oss.str());
+	}
+	// no trimming of the heap and no separately mapped large blocks, whose
+	// pages would be unmapped on free
+	::mallopt(M_TRIM_THRESHOLD, -1);
+	::mallopt(M_MMAP_MAX, 0);
+}
+
+} // namespace
@@ -0,0 +1,59 @@
+#ifndef __REALTIME__H
+#define __REALTIME__H
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ockl {
+
+/**
+ * Scheduling of a stage's threads, applied by the stage right after it
+ * created them. The default (priority 0, no cpus) leaves the threads to
+ * the normal scheduler on all CPUs.
+ */
+struct ThreadSettings {
+	/**
+	 * SCHED_FIFO priority (1..99), 0 for the normal scheduler. Needs
+	 * CAP_SYS_NICE or an rtprio limit in /etc/security/limits.conf.
+	 */
+	int priority;
+	/**
+	 * CPUs the threads may run on, empty for all
+	 */
+	std::vector<unsigned> cpus;
+};
+
+/**
+ * \param spec  <thread>:<cpus>, the cpus as a list of numbers and ranges,
+ *              e.g. "fft:2,4-5"
+ * \throws std::runtime_error for a malformed spec
+ */
+void parseAffinity(const std::string& spec, std::string& thread,
+		std::vector<unsigned>& cpus);
+
+/**
+ * \throws std::runtime_error if the scheduler refuses the settings
+ */
+void configureThread(std::thread& thread, const ThreadSettings& settings);
+
+/**
+ * e.g. "SCHED_FIFO 80, cpus 2,3", for the log
+ */
+std::string describe(const ThreadSettings& settings);
+
+/**
+ * Locks the current and all future pages of the process into memory, so
+ * neither the queue pools nor the fft buffers allocated afterwards are
+ * paged out or faulted in while running: with MCL_FUTURE every later
+ * allocation (and thread stack) is populated when it is mapped, that is
+ * at init. Freed memory is kept in the heap instead of being returned to
+ * the kernel, which would fault it in again on the next allocation.
+ *
+ * \throws std::runtime_error if the RLIMIT_MEMLOCK does not allow it
+ */
+void lockMemory();
+
+} // namespace
+
+#endif
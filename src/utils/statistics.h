@@ -0,0 +1,35 @@
+
+#ifndef __STATISTICS__H
+#define __STATISTICS__H
+
+#include <chrono>
+#include <cstdint>
+
+namespace ockl {
+
+/**
+ * Overrun statistics of a capture device, polled (and thereby reset) by the
+ * Watchdog just like the QueueStatistics.
+ */
+class CaptureStatistics {
+public:
+	virtual ~CaptureStatistics() {}
+
+	/**
+	 * \param xruns            overruns since the last call
+	 * \param lostFrames       frames lost in these overruns (estimated)
+	 * \param maxRecoveryTime  longest time it took to restart the device
+	 * \param meanWakeupLatency  mean time from a period becoming available
+	 *                          to the capture thread running, 0 if unknown
+	 * \param maxWakeupLatency   longest of these times
+	 */
+	virtual void getStats(unsigned& xruns,
+			uint64_t& lostFrames,
+			std::chrono::microseconds& maxRecoveryTime,
+			std::chrono::microseconds& meanWakeupLatency,
+			std::chrono::microseconds& maxWakeupLatency) = 0;
+};
+
+} // namespace
+
+#endif
@@ -10,6 +10,7 @@
 #include <utility>
 
 #include "queue.h"
+#include "statistics.h"
 #include "logger.h"
 
 namespace ockl {
@@ -52,11 +53,18 @@ public:
 		queues.insert(std::make_pair(queue, consumerName));
 	}
 
+	void addCapture(CaptureStatistics* capture, const std::string& name)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		captures.insert(std::make_pair(capture, name));
+	}
+
 private:
 	void threadFunction()
 	{
 		while (true) {
 			std::set<std::pair<QueueStatistics*, std::string>> queues;
+			std::set<std::pair<CaptureStatistics*, std::string>> captures;
 			{
 				std::unique_lock<std::mutex> lock(mutex);
 				if (doShutdown) {
@@ -67,10 +75,14 @@ private:
 					break;
 				}
 				queues.insert(this->queues.begin(), this->queues.end());
+				captures.insert(this->captures.begin(), this->captures.end());
 			}
 			for (auto element : queues) {
 				statCheck(element.first, element.second);
 			}
+			for (auto element : captures) {
+				statCheck(element.first, element.second);
+			}
 		}
 	}
 
@@ -79,7 +91,8 @@ private:
 		unsigned timeouts;
 		std::chrono::microseconds holdTime;
 		unsigned length;
-		queue->getStats(timeouts, holdTime, length);
+		unsigned dropped;
+		queue->getStats(timeouts, holdTime, length, dropped);
 		if (timeouts > 0 || holdTime > maxHoldTime) {
 			auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
 					holdTime);
@@ -87,11 +100,38 @@ private:
 					<< ", cycle time "
 					<< ms.count() << " [ms], length " << length);
 		}
+		if (dropped > 0) {
+			LOGGER_INFO(consumerName << " skipped " << dropped
+					<< " stale elements");
+		}
+	}
+
+	void statCheck(CaptureStatistics* capture, const std::string& name)
+	{
+		unsigned xruns;
+		uint64_t lostFrames;
+		std::chrono::microseconds maxRecoveryTime;
+		std::chrono::microseconds meanWakeupLatency;
+		std::chrono::microseconds maxWakeupLatency;
+		capture->getStats(xruns, lostFrames, maxRecoveryTime,
+				meanWakeupLatency, maxWakeupLatency);
+		if (xruns > 0) {
+			LOGGER_WARNING(name << " overruns " << xruns << ", lost frames "
+					<< lostFrames << ", max recovery time "
+					<< maxRecoveryTime.count() << " [us]");
+		}
+		// the scheduling jitter, to see whether priority and pinning work
+		if (maxWakeupLatency.count() > 0) {
+			LOGGER_INFO(name << " wakeup latency mean "
+					<< meanWakeupLatency.count() << ", max "
+					<< maxWakeupLatency.count() << " [us]");
+		}
 	}
 
 	std::chrono::milliseconds interval;
 	std::chrono::milliseconds maxHoldTime;
 	std::set<std::pair<QueueStatistics*, std::string>> queues;
+	std::set<std::pair<CaptureStatistics*, std::string>> captures;
 
 	std::thread* thread;
 	bool doShutdown;
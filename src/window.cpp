@@ -0,0 +1,99 @@
+
+#include <math.h>
+#include <stdexcept>
+
+#include "window.h"
+
+namespace ockl {
+
+namespace {
+
+/**
+ * Sum of cosines window: w(n) = a0 - a1 cos(x) + a2 cos(2x) - a3 cos(3x) ...
+ */
+std::vector<double>
+cosineSum(const std::vector<double>& coefficients, unsigned size)
+{
+	std::vector<double> window(size);
+	for (unsigned n = 0; n < size; n++) {
+		double x = 2 * M_PI * n / size;
+		double value = 0;
+		double sign = 1;
+		for (unsigned k = 0; k < coefficients.size(); k++) {
+			value += sign * coefficients[k] * cos(k * x);
+			sign = -sign;
+		}
+		window[n] = value;
+	}
+	return window;
+}
+
+} // namespace
+
+Window
+parseWindow(const std::string& name)
+{
+	for (Window window : {Window::Rectangular, Window::Hann,
+			Window::BlackmanHarris, Window::FlatTop}) {
+		if (name == windowName(window)) {
+			return window;
+		}
+	}
+	throw std::runtime_error("unknown window " + name);
+}
+
+std::string
+windowName(Window window)
+{
+	switch (window) {
+	case Window::Rectangular:
+		return "rectangular";
+	case Window::Hann:
+		return "hann";
+	case Window::BlackmanHarris:
+		return "blackman-harris";
+	case Window::FlatTop:
+		return "flat-top";
+	}
+	return "unknown";
+}
+
+std::vector<double>
+windowCoefficients(Window window)
+{
+	switch (window) {
+	case Window::Rectangular:
+		return {1.0};
+	case Window::Hann:
+		return {0.5, 0.5};
+	case Window::BlackmanHarris:
+		return {0.35875, 0.48829, 0.14128, 0.01168};
+	case Window::FlatTop:
+		return {0.21557895, 0.41663158, 0.277263158, 0.083578947,
+			0.006947368};
+	}
+	throw std::runtime_error("unknown window");
+}
+
+std::vector<double>
+makeWindow(Window window, unsigned size)
+{
+	if (window == Window::Rectangular) {
+		return std::vector<double>(size, 1.0);
+	}
+	return cosineSum(windowCoefficients(window), size);
+}
+
+double
+noiseBandwidth(Window window, unsigned size)
+{
+	double sum = 0;
+	double squares = 0;
+	for (double value : makeWindow(window, size)) {
+		sum += value;
+		squares += value * value;
+	}
+	return size * squares / (sum * sum);
+}
+
+} // namespace
@@ -0,0 +1,46 @@
+
+#ifndef __WINDOW__H
+#define __WINDOW__H
+
+#include <string>
+#include <vector>
+
+namespace ockl {
+
+/**
+ * Window functions applied to every fft frame before the transform. The
+ * periodic form is used (the window repeats after `size` samples), which
+ * is what you want for overlapping spectral analysis.
+ */
+enum class Window {
+	Rectangular,
+	Hann,
+	BlackmanHarris,
+	FlatTop
+};
+
+/**
+ * \throws std::runtime_error for an unknown name
+ */
+Window parseWindow(const std::string& name);
+
+std::string windowName(Window window);
+
+/**
+ * All windows are sums of cosines, w(n) = a0 - a1 cos(x) + a2 cos(2x) ...
+ * with x = 2 pi n / size. \return  a0, a1, ...
+ */
+std::vector<double> windowCoefficients(Window window);
+
+std::vector<double> makeWindow(Window window, unsigned size);
+
+/**
+ * Equivalent noise bandwidth [bins]: the width of the rectangular filter
+ * which passes as much white noise as the window, size * sum(w^2) /
+ * sum(w)^2. 1 for the rectangular window, 1.5 for hann.
+ */
+double noiseBandwidth(Window window, unsigned size);
+
+} // namespace
+
+#endif
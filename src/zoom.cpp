@@ -0,0 +1,263 @@
+
+#include <math.h>
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "zoom.h"
+
+namespace ockl {
+
+namespace {
+
+double
+dot(const double* __restrict a, const double* __restrict b, unsigned count)
+{
+	double sum = 0;
+	for (unsigned i = 0; i < count; i++) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+} // namespace
+
+ZoomSettings
+parseZoom(const std::string& value)
+{
+	std::size_t colon = value.find(':');
+	if (colon == std::string::npos) {
+		throw std::runtime_error("zoom needs <centre frequency>:<decimation>");
+	}
+	ZoomSettings settings;
+	settings.centerFrequency = std::stod(value.substr(0, colon));
+	std::string decimation = value.substr(colon + 1);
+	// stoul would take "-1" for the largest value
+	if (decimation.find('-') != std::string::npos) {
+		throw std::runtime_error("decimation must be positive");
+	}
+	unsigned long factor = std::stoul(decimation);
+	if (factor == 0 || factor > MaxDecimation) {
+		std::ostringstream message;
+		message << "decimation must be in the range [1, " << MaxDecimation
+				<< "]";
+		throw std::runtime_error(message.str());
+	}
+	settings.decimation = factor;
+	return settings;
+}
+
+Zoom::
+Zoom(const ZoomSettings& settings,
+		unsigned samplingRate,
+		bool lossless,
+		Queue<SamplingType>& inQueue,
+		Queue<double>& outQueue,
+		const Logger& logger)
+: settings(settings),
+  samplingRate(samplingRate),
+  lossless(lossless),
+  real(settings.decimation == 1 ? 1 : TapsPerPhase * settings.decimation),
+  imaginary(settings.decimation == 1 ? 1 : TapsPerPhase * settings.decimation),
+  phase(1.0),
+  step(1.0),
+  countdown(settings.decimation),
+  inQueue(inQueue),
+  outQueue(outQueue),
+  element(nullptr),
+  fill(0),
+  lostFrames(0),
+  logger(logger),
+  thread(nullptr),
+  doShutdown(false)
+{
+}
+
+Zoom::
+~Zoom()
+{
+	if (thread != nullptr) {
+		doShutdown = true;
+		thread->join();
+		delete thread;
+		thread = nullptr;
+	}
+	if (element != nullptr) {
+		outQueue.unallocate(element);
+	}
+}
+
+void
+Zoom::
+init()
+{
+	if (!taps.empty()) {
+		throw std::runtime_error("zoom already initialized");
+	}
+	if (fabs(settings.centerFrequency) >= samplingRate / 2.0) {
+		throw std::runtime_error("zoom centre frequency beyond nyquist");
+	}
+	if ((outQueue.getElementSize() & 1) != 0) {
+		throw std::runtime_error("zoom output elements must hold complex samples");
+	}
+
+	step = std::polar(1.0, -2 * M_PI * settings.centerFrequency / samplingRate);
+
+	// Blackman windowed sinc, cut off (-6 dB) at 0.45 of the new sampling
+	// rate. With 64 taps per phase the transition band is 0.17 of it wide,
+	// so the passband is flat (0.1 dB) up to 0.42 and the stopband (below
+	// -70 dB) starts at 0.49: nothing aliases into the band, but its outer
+	// 16% roll off.
+	unsigned length = settings.decimation == 1 ? 1
+			: TapsPerPhase * settings.decimation;
+	double cutoff = 0.45 / settings.decimation;
+	double center = (length - 1) / 2.0;
+	double sum = 0;
+	taps.resize(length);
+	for (unsigned i = 0; i < length; i++) {
+		double t = i - center;
+		double sinc = t == 0 ? 2 * cutoff
+				: sin(2 * M_PI * cutoff * t) / (M_PI * t);
+		double window = length == 1 ? 1.0
+				: 0.42 - 0.5 * cos(2 * M_PI * i / (length - 1))
+				+ 0.08 * cos(4 * M_PI * i / (length - 1));
+		taps[i] = sinc * window;
+		sum += taps[i];
+	}
+	for (double& tap : taps) {
+		tap /= sum;
+	}
+	// the history is oldest first, the filter wants the newest first
+	std::reverse(taps.begin(), taps.end());
+
+	LOGGER_INFO("zoom: " << settings.centerFrequency << " [Hz] +/- "
+			<< samplingRate / 2.0 / settings.decimation << " [Hz] (flat +/- "
+			<< FlatBand * samplingRate / settings.decimation << " [Hz]), "
+			<< length << " taps");
+}
+
+void
+Zoom::
+start()
+{
+	if (taps.empty()) {
+		throw std::runtime_error("zoom not initialized");
+	}
+
+	thread = new std::thread(&Zoom::threadFunction, this);
+	pthread_setname_np(thread->native_handle(), "zoom");
+}
+
+void
+Zoom::
+shutdown()
+{
+	doShutdown = true;
+}
+
+void
+Zoom::
+threadFunction()
+{
+	unsigned periodSize = inQueue.getElementSize();
+	unsigned elementSize = outQueue.getElementSize() / 2;
+	std::vector<double> mixedReal(periodSize);
+	std::vector<double> mixedImaginary(periodSize);
+	std::chrono::system_clock::time_point captureTime;
+
+	while (!doShutdown) {
+		SamplingType* inBuffer = inQueue.pop_front();
+		if (inBuffer == nullptr) {
+			continue;
+		}
+
+		const ElementInfo& info = Queue<SamplingType>::info(inBuffer);
+		unsigned valid = periodSize - info.padding;
+		captureTime = info.captureTime;
+		if (info.lostFrames > 0) {
+			real.clear();
+			imaginary.clear();
+			countdown = settings.decimation;
+			lostFrames += std::max<uint64_t>(1,
+					info.lostFrames / settings.decimation);
+			// Start the element over, so the gap falls on an element
+			// boundary and is marked in its lostFrames. The samples before
+			// the gap which do not make up a whole element are lost as well.
+			lostFrames += fill;
+			fill = 0;
+		}
+
+		for (unsigned i = 0; i < valid; i++) {
+			std::complex<double> mixed = (double) inBuffer[i] * phase;
+			mixedReal[i] = mixed.real();
+			mixedImaginary[i] = mixed.imag();
+			phase *= step;
+		}
+		// keep the rounding errors from piling up
+		phase /= std::abs(phase);
+
+		bool endOfStream = info.endOfStream;
+		inQueue.release(inBuffer);
+
+		unsigned offset = 0;
+		while (offset < valid && !doShutdown) {
+			unsigned count = std::min(valid - offset, countdown);
+			real.append(mixedReal.data() + offset, count);
+			imaginary.append(mixedImaginary.data() + offset, count);
+			offset += count;
+			countdown -= count;
+			if (countdown > 0) {
+				break;
+			}
+			countdown = settings.decimation;
+			if (!real.full()) {
+				continue;
+			}
+
+			if (element == nullptr && !nextElement()) {
+				lostFrames++;
+				continue;
+			}
+			if (fill == 0) {
+				ElementInfo& outInfo = Queue<double>::info(element);
+				outInfo.captureTime = captureTime;
+				outInfo.lostFrames = lostFrames;
+				lostFrames = 0;
+			}
+			element[2 * fill] = dot(taps.data(), real.latest(), taps.size());
+			element[2 * fill + 1] = dot(taps.data(), imaginary.latest(),
+					taps.size());
+			if (++fill == elementSize) {
+				outQueue.push_back(element);
+				element = nullptr;
+				fill = 0;
+			}
+		}
+
+		if (endOfStream && (element != nullptr || nextElement())) {
+			std::fill(element + 2 * fill, element + 2 * elementSize, 0.0);
+			ElementInfo& outInfo = Queue<double>::info(element);
+			outInfo.endOfStream = true;
+			outInfo.padding = 2 * (elementSize - fill);
+			outQueue.push_back(element);
+			element = nullptr;
+			fill = 0;
+		}
+	}
+}
+
+/**
+ * Allocates the next output element, waiting for it if lossless.
+ */
+bool
+Zoom::
+nextElement()
+{
+	element = outQueue.allocate();
+	while (element == nullptr && lossless && !doShutdown) {
+		element = outQueue.allocate();
+	}
+	return element != nullptr;
+}
+
+} // namespace
@@ -0,0 +1,116 @@
+
+#ifndef __ZOOM__H
+#define __ZOOM__H
+
+#include <atomic>
+#include <complex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "utils/history.h"
+#include "utils/logger.h"
+#include "utils/queue.h"
+#include "defs.h"
+
+namespace ockl {
+
+struct ZoomSettings {
+	/**
+	 * centre of the band of interest [Hz]
+	 */
+	double centerFrequency;
+	/**
+	 * the band is samplingRate / decimation wide, 1 disables zooming
+	 */
+	unsigned decimation;
+};
+
+/**
+ * upper bound for the decimation, the low pass has 64 taps per unit of it
+ */
+const unsigned MaxDecimation = 1024;
+
+/**
+ * Parses "<centre frequency [Hz]>:<decimation>".
+ * \throws std::runtime_error for an invalid value
+ */
+ZoomSettings parseZoom(const std::string& value);
+
+/**
+ * Zoom FFT front end between the capture and a complex input Fft: the
+ * samples are mixed down with a numerically controlled oscillator, so that
+ * the centre frequency ends up at 0 Hz, low pass filtered and decimated.
+ * The Fft then only transforms the band of interest, so a resolution which
+ * would need a huge transform of the whole band needs a `decimation` times
+ * smaller one.
+ *
+ * The low pass is a windowed sinc FIR which is only evaluated for the
+ * samples which are kept (the polyphase decimator: `decimation` times less
+ * work than filtering every sample). Its stopband starts at the new
+ * nyquist frequency, so nothing aliases into the band, and it is flat over
+ * the inner 84% of the band; levels in the outer 8% on either side read
+ * low. The output elements hold interleaved real and imaginary parts.
+ */
+class Zoom {
+public:
+	/**
+	 * \param lossless  wait for the output queue instead of dropping
+	 *                  samples when it is full, see FftSettings
+	 * \param outQueue  elements of 2 * (complex samples per element)
+	 */
+	Zoom(const ZoomSettings& settings,
+			unsigned samplingRate,
+			bool lossless,
+			Queue<SamplingType>& inQueue,
+			Queue<double>& outQueue,
+			const Logger& logger);
+	~Zoom();
+
+	void init();
+	void start();
+	void shutdown();
+
+private:
+	static const unsigned TapsPerPhase = 64;
+	/**
+	 * the passband is flat up to this fraction of the decimated sampling
+	 * rate, beyond it the band edges roll off to -6 dB at 0.45
+	 */
+	static constexpr double FlatBand = 0.42;
+
+	void threadFunction();
+	bool nextElement();
+
+	ZoomSettings settings;
+	unsigned samplingRate;
+	bool lossless;
+
+	std::vector<double> taps;
+	History<double> real;
+	History<double> imaginary;
+	/**
+	 * oscillator, advanced by `step` for every input sample
+	 */
+	std::complex<double> phase;
+	std::complex<double> step;
+	/**
+	 * input samples until the next output sample
+	 */
+	unsigned countdown;
+
+	Queue<SamplingType>& inQueue;
+	Queue<double>& outQueue;
+	double* element;
+	unsigned fill;
+	uint64_t lostFrames;
+
+	const Logger& logger;
+
+	std::thread* thread;
+	std::atomic<bool> doShutdown;
+};
+
+} // namespace
+
+#endif